@@ -0,0 +1,212 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3bench.c                                                    */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Host I/O engine benchmark, no hardware needed.  Each link is a master    */
+/*    and a slave joined by a socketpair, or a pty with -p, both run by one    */
+/*    p3loop.  Masters send the next request as soon as the reply arrives.     */
+/*                                                                             */
+/*    usage: p3bench [-u] [-p] [-n links] [-s seconds]                         */
+/*    -u uses the io_uring engine                                              */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE     // for posix_openpt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3loop.h"
+
+// master and slave channels for each link
+#define P3B_MAX_LINKS   (P3L_MAX_CHANNELS / 2)
+
+static  p3cmd   Cmd_Dev_Type            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
+
+static  p3channel   channel[ P3L_MAX_CHANNELS ];
+static  p3loop      loop;
+
+static  unsigned long   replies;
+static  unsigned long   timeouts;
+
+/*---------------------------------------------------------------------------*/
+/*  Reply arrived, count it and send the next request                        */
+/*---------------------------------------------------------------------------*/
+
+void
+P3BenchDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    (void)reply;
+    (void)context;
+
+    if( status == kP3ReqReply )
+        replies++;
+    else
+        timeouts++;
+
+    P3Request( MyComms, &Cmd_Dev_Type, CORTEX_DEVICE_ID, P3BenchDone, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  A connected pair of fds, pty master and slave or a socketpair            */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3BenchPair( int pty, int fd[2] )
+{
+    struct termios  tio;
+
+    if( !pty )
+        return( socketpair( AF_UNIX, SOCK_STREAM, 0, fd ) );
+
+    if( (fd[0] = posix_openpt( O_RDWR | O_NOCTTY )) < 0 )
+        return( -1 );
+    if( grantpt( fd[0] ) < 0 || unlockpt( fd[0] ) < 0 )
+        return( -1 );
+    if( (fd[1] = open( ptsname( fd[0] ), O_RDWR | O_NOCTTY )) < 0 )
+        return( -1 );
+
+    // no echo or line editing
+    tcgetattr( fd[1], &tio );
+    cfmakeraw( &tio );
+    tcsetattr( fd[1], TCSANOW, &tio );
+
+    return( 0 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  CPU time used in uS                                                      */
+/*---------------------------------------------------------------------------*/
+
+static long long
+P3BenchCpu( void )
+{
+    struct rusage   ru;
+
+    getrusage( RUSAGE_SELF, &ru );
+    return( (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL +
+             ru.ru_utime.tv_usec + ru.ru_stime.tv_usec );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Set up the links and run them for a while                                */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3comms     *master;
+    p3comms     *slave;
+    p3engine     engine  = kP3EngineEpoll;
+    int          pty     = 0;
+    int          links   = 16;
+    int          seconds = 5;
+    long long    start;
+    long long    cpu;
+    double       frames;
+    int          fd[2];
+    int          i;
+    int          c;
+
+    while( (c = getopt( argc, argv, "upn:s:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'u':   engine  = kP3EngineUring;   break;
+            case 'p':   pty     = 1;                break;
+            case 'n':   links   = atoi( optarg );   break;
+            case 's':   seconds = atoi( optarg );   break;
+            default:
+                fprintf(stderr, "usage: %s [-u] [-p] [-n links] [-s seconds]\n", argv[0] );
+                return(1);
+            }
+        }
+
+    if( links < 1 || links > P3B_MAX_LINKS )
+        links = P3B_MAX_LINKS;
+
+    if( P3LoopInit( &loop, engine ) != P3_SUCCESS )
+        {
+        perror("loop");
+        return(1);
+        }
+
+    for(i=0;i<links;i++)
+        {
+        if( P3BenchPair( pty, fd ) < 0 )
+            {
+            perror("pair");
+            return(1);
+            }
+
+        master = P3OpenFd( fd[0], kP3ModeMaster, 0 );
+        slave  = P3OpenFd( fd[1], kP3ModeSlave, 0 );
+        if( master == NULL || slave == NULL )
+            return(1);
+
+        slave->deviceType[0] = 0x12;
+        slave->deviceType[1] = 0x34;
+        P3SetAddress( slave, CORTEX_DEVICE_ID );
+
+        if( P3LoopAdd( &loop, &channel[i*2],   master ) != P3_SUCCESS ||
+            P3LoopAdd( &loop, &channel[i*2+1], slave  ) != P3_SUCCESS )
+            {
+            perror("add");
+            return(1);
+            }
+
+        P3Request( master, &Cmd_Dev_Type, CORTEX_DEVICE_ID, P3BenchDone, NULL );
+        }
+
+    start = P3LoopMicros();
+    cpu   = P3BenchCpu();
+
+    while( P3LoopMicros() - start < seconds * 1000000LL )
+        P3LoopOnce( &loop );
+
+    start  = P3LoopMicros() - start;
+    cpu    = P3BenchCpu() - cpu;
+    frames = replies * 2.0;
+
+    printf("%s %s links %d\n", engine == kP3EngineUring ? "io_uring" : "epoll",
+            pty ? "pty" : "socketpair", links );
+    printf("  frames/s %.0f  cpu uS/frame %.2f  frames/wait %.2f  timeouts %lu  dropped %lu\n",
+            frames * 1000000.0 / start, frames ? cpu / frames : 0.0,
+            loop.waits ? frames / loop.waits : 0.0, timeouts, loop.dropped );
+
+    return(0);
+}
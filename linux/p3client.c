@@ -0,0 +1,224 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3client.c                                                   */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Example client for a link shared by p3daemon -m or -g                    */
+/*    Identifies the slave through the daemon, then with -m prints every       */
+/*    frame the daemon receives on the link.  With -g sends count identify     */
+/*    requests to a gateway link in one batch and times the replies            */
+/*                                                                             */
+/*    usage: p3client [-m] /p3-<device>                                        */
+/*           p3client -g [-l link] [-n count] socket                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3shm.h"
+#include "p3gate.h"
+
+static  p3gatebatch batch;
+
+static  p3cmd   Cmd_Identify            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_IDENTIFY,     0, {0x00} };
+
+/*---------------------------------------------------------------------------*/
+/*  Print the strings from an identify reply                                 */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ClientIdentity( p3cmdfull *reply )
+{
+    unsigned char  *p   = &reply->data[ P3_IDENTIFY_FIXED_LEN ];
+    unsigned char  *end = &reply->data[ reply->length ];
+    int             i;
+
+    printf("device type %02X%02X firmware %d.%d.%d hardware %d.%d.%d\n",
+            reply->data[0], reply->data[1], reply->data[2], reply->data[3], reply->data[4],
+            reply->data[7], reply->data[8], reply->data[9] );
+
+    // manufacturer, product name and serial number, each a length and the characters
+    for(i=0;i<3 && p < end;i++)
+        {
+        printf("  %.*s\n", *p, (char *)(p + 1) );
+        p += *p + 1;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Gateway - one batch of identify requests, wait for all the replies       */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3ClientGate( char *path, int link, int count )
+{
+    p3gaterec       rec;
+    unsigned char  *buf;
+    struct timespec t0, t1;
+    double          us;
+    int             len = 0;
+    int             got = 0;
+    int             replies = 0;
+    int             batches = 0;
+    int             pos;
+    int             fd;
+    int             n;
+    int             i;
+
+    if( (fd = P3GateConnect( path )) < 0 )
+        {
+        perror( path );
+        return(1);
+        }
+
+    if( (buf = malloc( count * sizeof(p3gaterec) )) == NULL )
+        return(1);
+
+    for(i=0;i<count;i++)
+        {
+        memset( &rec, 0, sizeof(rec) );
+        rec.id     = i + 1;
+        rec.link   = link;
+        rec.dev_id = CORTEX_DEVICE_ID;
+        memcpy( &rec.cmd, &Cmd_Identify, Cmd_Identify.length + 3 );
+        len += P3GatePut( buf + len, &rec );
+        }
+
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+
+    if( P3GateSend( fd, buf, len, count ) != P3_SUCCESS )
+        {
+        perror("send");
+        return(1);
+        }
+
+    while( got < count && P3GateRecv( fd, &batch ) == P3_SUCCESS )
+        {
+        batches++;
+        for( pos = 0; (n = P3GateGet( batch.data + pos, batch.length - pos, &rec )) > 0; pos += n )
+            {
+            got++;
+            if( rec.status != kP3ReqReply )
+                continue;
+            if( replies++ == 0 )
+                P3ClientIdentity( &rec.cmd );
+            }
+        P3GateRelease( &batch );
+        }
+
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+
+    printf("%d requests in one batch of %d bytes%s\n", count, len, len > P3G_INLINE_MAX ? " (memfd)" : "" );
+    printf("%d replies, %d answered, in %d batches, %.1f uS per request\n",
+            got, replies, batches, us / count );
+
+    free( buf );
+    close( fd );
+
+    return( got == count ? 0 : 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Attach, identify and optionally monitor                                  */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3shm       *shm;
+    p3shmframe  *f;
+    p3cmdfull    reply;
+    int          flags = 0;
+    int          gateway = 0;
+    int          link  = 0;
+    int          count = 1;
+    int          status;
+    int          i;
+    int          c;
+
+    while( (c = getopt( argc, argv, "mgl:n:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'm':   flags |= P3S_MONITOR;   break;
+            case 'g':   gateway = 1;            break;
+            case 'l':   link  = atoi( optarg ); break;
+            case 'n':   count = atoi( optarg ); break;
+            default:
+                fprintf(stderr, "usage: %s [-m] /p3-<device>\n       %s -g [-l link] [-n count] socket\n", argv[0], argv[0] );
+                return(1);
+            }
+        }
+
+    if( optind >= argc || count < 1 || count > 65535 )
+        {
+        fprintf(stderr, "usage: %s [-m] /p3-<device>\n       %s -g [-l link] [-n count] socket\n", argv[0], argv[0] );
+        return(1);
+        }
+
+    if( gateway )
+        return( P3ClientGate( argv[optind], link, count ) );
+
+    if( (shm = P3ShmAttach( argv[optind], flags )) == NULL )
+        {
+        perror( argv[optind] );
+        return(1);
+        }
+
+    status = P3ShmTransact( shm, &Cmd_Identify, CORTEX_DEVICE_ID, &reply, 1000 );
+    if( status == kP3ReqReply )
+        P3ClientIdentity( &reply );
+    else
+        printf("no reply to identify, status %d\n", status );
+
+    // frames are read where the daemon put them
+    while( flags & P3S_MONITOR )
+        {
+        while( (f = P3ShmPeek( shm )) != NULL )
+            {
+            printf("%02X %02X %02X len %3d :", f->dev_id, f->cmd.cmd1, f->cmd.cmd2, f->cmd.length );
+            for(i=0;i<f->cmd.length && i<P3_FULL_MSG;i++)
+                printf(" %02X", f->cmd.data[i] );
+            printf("\n");
+            P3ShmRelease( shm );
+            }
+
+        P3ShmWait( shm, -1 );
+        }
+
+    P3ShmDetach( shm );
+
+    return(0);
+}
@@ -0,0 +1,548 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*                        Copyright (c) James Pearman                          */
+/*                                   2013                                      */
+/*                            All Rights Reserved                              */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3comms.h                                                    */
+/*    Author:     James Pearman                                                */
+/*    Created:    4 Oct 2011                                                   */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00     5 Sept 2013 - Initial release fopr ConVEX          */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This file is part of ConVEX.                                             */
+/*                                                                             */
+/*    The author is supplying this software for use with the VEX cortex        */
+/*    control system. ConVEX is free software; you can redistribute it         */
+/*    and/or modify it under the terms of the GNU General Public License       */
+/*    as published by the Free Software Foundation; either version 3 of        */
+/*    the License, or (at your option) any later version.                      */
+/*                                                                             */
+/*    ConVEX is distributed in the hope that it will be useful,                */
+/*    but WITHOUT ANY WARRANTY; without even the implied warranty of           */
+/*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            */
+/*    GNU General Public License for more details.                             */
+/*                                                                             */
+/*    You should have received a copy of the GNU General Public License        */
+/*    along with this program.  If not, see <http://www.gnu.org/licenses/>.    */
+/*                                                                             */
+/*    A special exception to the GPL can be applied should you wish to         */
+/*    distribute a combined work that includes ConVEX, without being obliged   */
+/*    to provide the source code for any proprietary components.               */
+/*    See the file exception.txt for full details of how and when the          */
+/*    exception can be applied.                                                */
+/*                                                                             */
+/*    The author can be contacted on the vex forums as jpearman                */
+/*    or electronic mail using jbpearman_at_mac_dot_com                        */
+/*    Mentor for team 8888 RoboLancers, Pasadena CA.                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Header for p3comms.c                                                     */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#ifndef P3COMMS_H_
+#define P3COMMS_H_
+
+// function return values
+#define P3_SUCCESS      0
+#define P3_FAILURE      (-1)
+
+// This can be 1 or 2 on the cortex
+#ifndef P3_MAX_PORTS
+#define P3_MAX_PORTS    1
+#endif
+
+// Most messages are 29 bytes of data to save memory
+#define P3_SMALL_MSG    (32-3)
+// full messages limited in this implementation to save memory
+// theoretically we could have up to 255 bytes of payload data but
+// most commands will never use that.  This version for ROBOTC is
+// more constrained and just an example so we limit to 125 bytes
+#define P3_FULL_MSG     (128-3)
+
+// Structure to hold p3 command limited to P3_SMALL_MSG bytes of data
+// (P3_SMALL_MSG+3) bytes total
+// this is enough for most typical commands
+// use p3cmdfull for larger ammounts of data
+
+typedef struct _p3cmd {
+    unsigned char   cmd1;
+    unsigned char   cmd2;
+    unsigned char   length;
+    unsigned char   data[P3_SMALL_MSG];
+    } p3cmd;
+
+// Structure to hold p3 command limited to P3_FULL_MSG bytes of data
+// (P3_FULL_MSG+3) bytes total
+
+typedef struct _p3cmdfull {
+    unsigned char   cmd1;
+    unsigned char   cmd2;
+    unsigned char   length;
+    unsigned char   data[P3_FULL_MSG];
+    } p3cmdfull;
+
+// ROBOTC does not support nested structures so I had to break these out
+typedef struct __cmdpak {
+    unsigned char   preamble1;
+    unsigned char   preamble2;
+    p3cmdfull       cmd;
+    } _cmdpak;
+
+typedef union __command {
+    _cmdpak         cmdpak;
+    unsigned char   data[sizeof(_cmdpak) + 1];  // and the checksum of a full frame
+    } _command;
+
+// Structure to hold transmit or receive packet
+typedef struct _p3packet {
+    _command        command;
+    short           cmd_cnt;
+    short           cmd_len;
+    unsigned char   chk_sum;
+    unsigned char   dev_id;
+    unsigned char   masked_cmd1;
+    } p3pak;
+
+#define P3_BAUD                     115200
+
+#define P3_RX_BUF_SIZE              256
+#define P3_RX_NO_DATA               -1
+#define P3_RX_BUF_ERR               -2
+
+// Fixed preambles for the P3 messages
+#define P3_PREAMBLE1                0x50
+#define P3_PREAMBLE2                0xAF
+
+#define MANUFACTURER_STRING_LEN     32
+#define PRODUC_TNAME_STRING_LEN     32
+#define SERIAL_NUMBER_STRING_LEN    32
+
+// Defined command 1 groups (4 bits max)
+#define CMD1_GROUP_SYSTEM_CMD       0
+#define CMD1_GROUP_SYSTEM_REPLY     1
+#define CMD1_GROUP_CONTROL          2
+#define CMD1_GROUP_PRESET           4
+#define CMD1_GROUP_STATUS           6
+#define CMD1_GROUP_STATUS_REPLY     7
+#define CMD1_GROUP_FACTORY          0x0F
+
+// Defined command 2 commands
+#define CMD2_SYSTEM_ACK             0x10
+#define CMD2_SYSTEM_DEVICE_TYPE     0x11
+#define CMD2_SYSTEM_NAK             0x12
+#define CMD2_SYSTEM_MANUFACTURER    0x13
+#define CMD2_SYSTEM_PRODUCT_NAME    0x14
+#define CMD2_SYSTEM_SERIAL_NUM      0x15
+#define CMD2_SYSTEM_IDENTIFY        0x16    // all of the above in one reply
+#define CMD2_SYSTEM_STAGE           0x17    // hold a command until commit
+#define CMD2_SYSTEM_COMMIT          0x18    // apply staged commands, usually broadcast
+
+#define CMD2_SYSTEM_FIRMWARE        0x20
+#define CMD2_SYSTEM_HARDWARE        0x21
+
+// Mirrored state groups, see P3MirrorSync
+#define CMD1_GROUP_MIRROR           8
+#define CMD1_GROUP_MIRROR_REPLY     9
+
+#define CMD2_MIRROR_SYNC            0x10
+
+// first data byte of a mirror sync, remaining data is a list of
+// ranges each as offset, length and then length bytes of data
+#define P3_MIRROR_FLAG_ACK          0x01    // previous mirror reply received
+#define P3_MIRROR_FLAG_HEARTBEAT    0x02    // reply only, see P3_ACK_HEARTBEAT
+
+// identify reply is device type (2), firmware (5) and hardware (3)
+// followed by manufacturer, product name and serial number each as
+// a length byte and then the string without terminator
+#define P3_IDENTIFY_FIXED_LEN       10
+
+// device type reply may be followed by a 4 byte identity fingerprint,
+// older masters only read the first 2 bytes
+#define P3_DEVICE_TYPE_LEN          2
+#define P3_FINGERPRINT_LEN          4
+
+// first data byte of an ACK, set when the slave application has
+// called P3Heartbeat since the last ACK
+#define P3_ACK_HEARTBEAT            0x01
+
+#define CORTEX_DEVICE_ID            0x00
+#define GLOBAL_DEVICE_ID            0x0F
+
+// commit data is a mask of the groups that apply their staged
+// command, slaves are in all groups unless set by P3SetGroups
+#define P3_GROUP_ALL                0xFF
+
+// slave address that accepts frames for every dev_id, see P3SetAddress
+#define P3_ADDRESS_ANY              (-1)
+
+// Size of the mirrored state region in each direction, offsets are sent
+// as a single byte so this must be no more than 256
+#ifndef P3_MIRROR_SIZE
+#define P3_MIRROR_SIZE              64
+#endif
+#define P3_MIRROR_WORDS             ((P3_MIRROR_SIZE+31)/32)
+// dirty ranges closer than this are sent as one range
+#define P3_MIRROR_GAP               2
+
+// Master liveness, a device is only probed when nothing valid has been
+// received from it for the quiet period.  While the device is absent
+// the probe interval doubles up to the maximum.  Both in calls to
+// P3CommsTask
+#ifndef P3_LIVENESS_QUIET
+#define P3_LIVENESS_QUIET           50
+#endif
+#ifndef P3_PROBE_INTERVAL_MAX
+#define P3_PROBE_INTERVAL_MAX       1000
+#endif
+
+// mode determines whether we are running as a master (host) or slave (client)
+typedef enum  {
+    kP3ModeSlave = 0,
+    kP3ModeMaster
+    } p3mode;
+
+// communications phase
+typedef enum  {
+    kP3StateIdle = 0,
+    kP3StateCommandWait,
+    kP3StateReplyWait,
+    kP3StateReplyWaitTxPend,
+    kP3StateTimeout
+    } p3state;
+
+// Mirrored state, one bit per byte in the dirty and inflight maps
+typedef struct _p3mirror {
+    unsigned char   data[P3_MIRROR_SIZE];
+    unsigned int    dirty[P3_MIRROR_WORDS];     // changed and not yet sent
+    unsigned int    inflight[P3_MIRROR_WORDS];  // sent and not yet acknowledged
+    } p3mirror;
+
+// Number of status replies the slave can build ahead of time
+#ifndef P3_MAX_PREBUILT
+#define P3_MAX_PREBUILT             2
+#endif
+
+// encoded size of a p3cmd frame
+#define P3_SMALL_FRAME              (P3_SMALL_MSG+6)
+
+// Queue of decoded commands with one producer and one consumer task,
+// size must be a power of 2
+#ifndef P3_CMD_QUEUE_SIZE
+#define P3_CMD_QUEUE_SIZE           8
+#endif
+
+typedef struct _p3cmdqueue {
+    p3cmd                   cmd[P3_CMD_QUEUE_SIZE];
+    volatile unsigned int   head;       // only written by the producer
+    volatile unsigned int   tail;       // only written by the consumer
+    } p3cmdqueue;
+
+// Commands submitted from any task and sent by the comms task,
+// size must be a power of 2
+#ifndef P3_SUBMIT_QUEUE_SIZE
+#define P3_SUBMIT_QUEUE_SIZE        8
+#endif
+
+// how a request finished, passed to the completion callback
+typedef enum  {
+    kP3ReqReply = 0,                    // reply received
+    kP3ReqNak,                          // NAK or corrupt reply received
+    kP3ReqTimeout,                      // nothing received
+    kP3ReqClosed                        // link closed, see P3Close
+    } p3reqstatus;
+
+struct _p3comms;
+
+typedef struct _p3submit {
+    volatile unsigned int   seq;        // slot sequence, see P3Submit
+    unsigned char           dest_id;
+    p3cmd                   cmd;
+
+    // called by the comms task when the request finishes
+    void                   (*complete)( struct _p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context );
+    void                    *context;
+    } p3submit;
+
+// Identity of a device decoded by the master from its replies, the
+// fingerprint lets a reconnect skip identify, see P3IdentityRestore
+typedef struct _p3identity {
+    int             dev_id;             // -1 until a reply arrives
+    unsigned long   fingerprint;        // 0 until saved
+    unsigned char   deviceType[2];
+    unsigned char   manufacturer[MANUFACTURER_STRING_LEN];
+    unsigned char   product_name[PRODUC_TNAME_STRING_LEN];
+    unsigned char   serial_number[SERIAL_NUMBER_STRING_LEN];
+    unsigned char   firmware_version[5];
+    unsigned char   hardware_version[3];
+    } p3identity;
+
+// Devices on a multi-drop bus, dev_id 0 to P3_MAX_DEVICES-1, the
+// global id is never a device
+#ifndef P3_MAX_DEVICES
+#define P3_MAX_DEVICES              15
+#endif
+
+// calls to P3CommsTask to wait for a reply
+#define P3_REPLY_TIMEOUT            5
+
+// mS a P3Transact caller waits, long after the comms task would have
+// timed the request out itself
+#ifndef P3_TRANSACT_TIMEOUT
+#define P3_TRANSACT_TIMEOUT         500
+#endif
+
+// What the master knows about each device, times are in calls to P3CommsTask
+typedef struct _p3device {
+    int             online;             // 2 on a valid frame, less 1 each timeout
+    int             tcount;             // number of timeouts
+    int             timeout;            // reply timeout for this device
+    unsigned long   lastRx;             // last valid frame received
+    unsigned long   lastHeartbeat;      // last reply with the heartbeat flag
+    unsigned long   heartbeats;         // and how many, 0 for a slave that never sends it
+    unsigned long   fingerprint;        // from the last device type reply, 0 for none
+
+    // liveness probes, see P3SetLiveness
+    int             probeQuiet;         // 0 if not probed
+    int             probeInterval;
+    unsigned long   probeAt;            // next probe allowed
+
+    p3identity      identity;
+    } p3device;
+
+// Cyclic schedule the master comms task runs ahead of any other
+// traffic, see P3ScheduleAdd
+#ifndef P3_MAX_SLOTS
+#define P3_MAX_SLOTS                8
+#endif
+
+// time between calls to P3CommsTask, the demo calls every 2mS
+#ifndef P3_TICK_US
+#define P3_TICK_US                  2000
+#endif
+
+// start bit, 8 data bits, odd parity and stop bit
+#define P3_BITS_PER_BYTE            11
+
+// schedule admission limit in parts per thousand of the link, the
+// rest is left for submitted commands and probes
+#ifndef P3_SCHEDULE_MAX_LOAD
+#define P3_SCHEDULE_MAX_LOAD        800
+#endif
+
+// Slots are sent earliest deadline first, the deadline being the end
+// of the period, ties go to the higher priority
+typedef struct _p3slot {
+    unsigned char   dest_id;
+    p3cmd          *cmd;
+    int             period;             // calls to P3CommsTask
+    int             priority;           // higher first when deadlines are equal
+    int             load;               // parts per thousand of the link
+    unsigned long   due;                // next release
+    unsigned long   fresh;              // last value pushed by the slave
+    int             freshValid;
+    unsigned long   sent;
+    unsigned long   skipped;            // releases skipped as data was fresh
+    unsigned long   misses;             // periods that passed without a send
+
+    // called by the comms task when each request finishes
+    void           (*complete)( struct _p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context );
+    void            *context;
+    } p3slot;
+
+// A status reply built by the slave while idle, double buffered so
+// a complete frame is always ready to send
+typedef struct _p3prebuilt {
+    unsigned char   cmd1;           // request group this answers
+    unsigned char   cmd2;           // request command this answers
+    p3cmd          *reply;          // reply template, data filled by refresh
+    int            (*refresh)( struct _p3comms *MyComms, p3cmd *reply );
+
+    unsigned char   frame[2][P3_SMALL_FRAME];
+    short           frame_len[2];
+    int             front;          // frame ready to send, -1 for none
+    } p3prebuilt;
+
+// A structure to collect all information together for a single
+// communicatuoibs channel
+typedef struct _p3comms {
+    int             port;       // which Uart
+    long            baud;       // baud rate of channel
+    p3mode          mode;       // master or slave
+    p3state         state;      // communications state
+    int             tcount;     // number of timeouts
+
+    int             online;     // status of slave (master mode only)
+
+    // Liveness, times are in calls to P3CommsTask
+    unsigned long   ticks;
+    int             step;                       // ticks since the last call
+    volatile int    heartbeat;                  // slave, application is alive
+
+    // Staged command applied on commit (slave only)
+    p3pak           StagePak;
+    int             stageValid;
+    int             address;                    // slave dev_id or P3_ADDRESS_ANY
+    int             groupMask;                  // groups this slave is in
+    int             rxSkip;                     // frame being received is not ours
+    int             noReply;                    // drop replies, used for broadcasts
+
+    // Routing, frames for a dev_id with a route are sent on to that
+    // port as they arrive rather than decoded here
+    struct _p3comms *route[16];
+    struct _p3comms *forward;                   // port the current frame goes to
+
+    // Per device state and bus scheduling (master only)
+    p3device        device[P3_MAX_DEVICES];
+    int             waitId;                     // device the last frame was sent to
+    int             probeNext;                  // next device to consider probing
+
+    // Cyclic schedule (master only)
+    p3slot          slot[P3_MAX_SLOTS];
+    int             slotCount;
+    int             scheduleLoad;               // parts per thousand of the link
+
+    // Transmit and Receive packets
+    p3pak           TxPak;
+    p3pak           RxPak;
+    p3pak           ExPak;
+
+    // Receive buffer
+    int             rxcnt;                      // last amount of rx data
+    unsigned char   rxbuf[P3_RX_BUF_SIZE];      // buffer for rx data
+    int             rxto;                       // timeout counter
+
+    // Mirrored state
+    p3mirror        MirrorTx;                   // our state, pushed to the remote
+    unsigned char   MirrorRx[P3_MIRROR_SIZE];   // copy of the remote state
+    int             MirrorRxCount;              // number of mirror updates applied
+    int             MirrorAck;                  // master, reply to last sync received
+    volatile int    MirrorSyncId;               // master, sync requested to this id + 1
+    int             MirrorWait;                 // master, last frame sent was a sync
+    int             MirrorNakCount;             // master, syncs NAKed by a slave without mirroring
+
+    // Commands submitted by other tasks
+    p3submit                submit[P3_SUBMIT_QUEUE_SIZE];
+    volatile unsigned int   submitHead;         // next slot to claim, any task
+    volatile unsigned int   submitTail;         // next slot to send, comms task
+    volatile int            closed;             // see P3Close
+
+    // Completion for the request waiting for a reply (master only)
+    void           (*complete)( struct _p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context );
+    void            *completeContext;
+    int             completeId;                 // device the request was sent to
+
+    // Prebuilt status replies (slave mode only)
+    p3prebuilt      prebuilt[P3_MAX_PREBUILT];
+    int             prebuiltCount;
+    int             prebuiltNext;               // next to refresh
+
+    // debug
+    int             debug;
+    int             DebugTx;    // display transmit packets on console
+    int             DebugRx;    // display receive packets on console
+
+    // Callbacks
+    int            (*init)( struct _p3comms *MyComms, long baud );
+    int            (*deinit)( struct _p3comms *MyComms );
+    int            (*flush)( struct _p3comms *MyComms );
+    int            (*write_buf)( struct _p3comms *MyComms, unsigned char *buffer, int len );
+    int            (*peek_input)( struct _p3comms *MyComms );
+    int            (*get_byte)( struct _p3comms *MyComms );
+    int            (*read_buf)( struct _p3comms *MyComms, unsigned char *buffer, int len );  // optional, used instead of get_byte
+    int            (*packet_decode)( struct _p3comms *MyComms, p3pak *packet );
+    void           (*wake)( struct _p3comms *MyComms, void *context );  // optional, work submitted
+    void            *wakeContext;
+    void           (*monitor)( struct _p3comms *MyComms, p3pak *packet, void *context );  // optional, every good frame
+    void            *monitorContext;
+
+    // Pointer to driver
+    void            *sdp;
+    int             fd;         // file descriptor for host targets
+
+    // identity a slave replies with, the master keeps each device's
+    // in device[].identity
+    unsigned char  deviceType[2];
+    unsigned char  manufacturer[MANUFACTURER_STRING_LEN];
+    unsigned char  product_name[PRODUC_TNAME_STRING_LEN];
+    unsigned char  serial_number[SERIAL_NUMBER_STRING_LEN];
+    unsigned char  firmware_version[5];
+    unsigned char  hardware_version[3];
+} p3comms;
+
+
+// Prototypes
+p3comms *   P3Init(int port, p3mode mode, int debug_flag, long baud );
+p3comms *   P3Open( char *device, p3mode mode, int debug_flag, long baud );
+p3comms *   P3OpenFd( int fd, p3mode mode, int debug_flag );
+void        P3Deinit(p3comms *MyComms);
+void        P3Close( p3comms *MyComms );
+int         P3InitSerial(p3comms *MyComms);
+int         P3Command( p3comms *MyComms, void *command, int dest_id  );
+int         P3EncodeFrame( unsigned char *frame, void *command, int dest_id );
+int         P3Submit( p3comms *MyComms, void *command, int dest_id );
+int         P3Request( p3comms *MyComms, void *command, int dest_id, void *callback, void *context );
+int         P3Transact( p3comms *MyComms, void *command, int dest_id, p3cmdfull *reply, int timeout );
+int         P3ScheduleAdd( p3comms *MyComms, int dest_id, p3cmd *cmd, int reply_len, int period, void *callback, void *context );
+int         P3ScheduleLoad( p3comms *MyComms );
+void        P3SchedulePriority( p3comms *MyComms, int index, int priority );
+void        P3ScheduleFresh( p3comms *MyComms, int index );
+void        P3DebugSchedule( p3comms *MyComms );
+int         P3Stage( p3comms *MyComms, void *command, int dest_id );
+int         P3Commit( p3comms *MyComms, int groups );
+void        P3SetAddress( p3comms *MyComms, int address );
+void        P3SetGroups( p3comms *MyComms, int groups );
+void        P3SetRoute( p3comms *MyComms, int dev_id, p3comms *to );
+void        P3SendPending( p3comms *MyComms );
+void        P3DebugPacket( p3pak *packet );
+int         P3SendPacket( p3comms *MyComms, p3pak *packet );
+int         P3ReceiveData( p3comms *MyComms);
+void        P3ReceivePacket( p3comms *MyComms );
+void        P3DecodePacket( p3comms *MyComms, p3pak *packet );
+void        P3DecodeSysCtl( p3comms *MyComms, p3pak *packet );
+void        P3DecodeSysReply( p3comms *MyComms, p3pak *packet );
+int         P3CommsTask( p3comms *MyComms );
+int         P3CommsRun( p3comms *MyComms, int elapsed );
+int         P3CommsNext( p3comms *MyComms );
+
+p3device *  P3GetDevice( p3comms *MyComms, int dev_id );
+void        P3SetLiveness( p3comms *MyComms, int dest_id, int quiet );
+void        P3Heartbeat( p3comms *MyComms );
+int         P3DeviceAlive( p3comms *MyComms, int dev_id, int quiet );
+
+int         P3MirrorWrite( p3comms *MyComms, int offset, unsigned char *data, int len );
+int         P3MirrorRead( p3comms *MyComms, int offset, unsigned char *data, int len );
+int         P3MirrorSync( p3comms *MyComms, int dest_id );
+void        P3DecodeMirror( p3comms *MyComms, p3pak *packet );
+
+void        P3QueueInit( p3cmdqueue *queue );
+int         P3QueuePut( p3cmdqueue *queue, void *command );
+int         P3QueueGet( p3cmdqueue *queue, p3cmd *command );
+
+int         P3RegisterPrebuilt( p3comms *MyComms, int cmd1, int cmd2, p3cmd *reply, void *refresh );
+void        P3RefreshPrebuilt( p3comms *MyComms );
+int         P3SendPrebuilt( p3comms *MyComms, p3pak *packet );
+
+unsigned long P3Fingerprint( p3comms *MyComms );
+p3identity *P3IdentityLookup( p3comms *MyComms, int dev_id );
+void        P3IdentitySave( p3comms *MyComms, int dev_id );
+int         P3IdentityRestore( p3comms *MyComms, int dev_id );
+
+void        P3SetReplyDecoder( p3comms *MyComms, void *callback );
+void        P3SetWake( p3comms *MyComms, void *callback, void *context );
+void        P3SetMonitor( p3comms *MyComms, void *callback, void *context );
+void        P3SetManufacturerString( p3comms *MyComms, char *str );
+void        P3SetProductNameString( p3comms *MyComms, char *str );
+void        P3SetSerialNumberString( p3comms *MyComms, char *str );
+void        P3SetFirmwareVersion( p3comms *MyComms, unsigned char major, unsigned char minor, unsigned char bug, unsigned short build );
+void        P3SetHardwareVersion( p3comms *MyComms, unsigned char major, unsigned char minor, unsigned char revision );
+
+#endif /* P3COMMS_H_ */
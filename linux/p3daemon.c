@@ -0,0 +1,432 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3daemon.c                                                   */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Multi-port master for a Linux host                                       */
+/*    The links are shared out between worker threads, one per core.  Each     */
+/*    worker runs its own p3loop and a channel only when it has data or a      */
+/*    timer is due, so an idle link costs nothing.  Workers share nothing,     */
+/*    other threads hand them requests through the lock free submit queue of   */
+/*    each channel and an eventfd wakes the worker                             */
+/*                                                                             */
+/*    usage: p3daemon [-d] [-u] [-m] [-g socket] [-b baud] [-t threads]        */
+/*           device [...]                                                      */
+/*    -u uses the io_uring engine                                              */
+/*    -m shares each link with other processes as /p3-<device>, see p3shm.c    */
+/*    -g serves the links on a unix domain socket, see p3gate.c                */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE     // for pthread_setaffinity_np
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3loop.h"
+#include "p3shm.h"
+#include "p3gate.h"
+
+// worker threads, the default is one per core
+#ifndef P3D_MAX_WORKERS
+#define P3D_MAX_WORKERS     16
+#endif
+
+/*---------------------------------------------------------------------------*/
+/*  define application specific commands                                     */
+/*---------------------------------------------------------------------------*/
+
+#define CMD2_STATUS_GETMOTORS           0x10
+
+static  p3cmd   Cmd_Motor_Status_Req    = { CMD1_GROUP_STATUS,  CMD2_STATUS_GETMOTORS,           0, {0} };
+static  p3cmd   Cmd_Dev_Type            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
+static  p3cmd   Cmd_Identify            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_IDENTIFY,     0, {0x00} };
+
+/*---------------------------------------------------------------------------*/
+/*  One serial link, only touched by the worker that owns it                 */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3link {
+    p3channel       ch;
+    char           *device;
+    p3device       *slave;
+    int             online;     // last online state reported
+    int             closed;     // closed reported
+    p3shm          *shm;        // shared with other processes, NULL if not
+
+    short           motor[10];  // remote motor values
+    } p3link;
+
+/*---------------------------------------------------------------------------*/
+/*  One event loop on its own core                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3worker {
+    p3loop          loop;
+    pthread_t       thread;
+    int             cpu;
+    volatile int    stop;       // set by the main thread on the way out
+    } p3worker;
+
+static  p3link     *links;          // one for each device named
+static  int         linkCount;
+
+static  p3worker    worker[ P3D_MAX_WORKERS ];
+static  int         workerCount;
+
+static  p3gate      gate;
+static  char       *gatePath;
+
+/*---------------------------------------------------------------------------*/
+/*  Motor status reply, called by the engine when the request finishes       */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UserMotorStatusDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3link      *ln = (p3link *)context;
+    p3cmdfull   *cmd;
+    int          i;
+
+    (void)MyComms;
+
+    // nothing to do for a NAK or timeout
+    if( status != kP3ReqReply )
+        return;
+
+    cmd = &reply->command.cmdpak.cmd;
+
+    // data is in range 0-254, shift to +/- 127
+    if( (cmd->cmd2 == CMD2_STATUS_GETMOTORS) && (cmd->length == 10) )
+        {
+        for(i=0;i<10;i++)
+            ln->motor[i] = cmd->data[i] - 0x7F;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Identify reply, the engine has already saved the strings                 */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UserIdentifyDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3link      *ln = (p3link *)context;
+    p3identity  *id;
+
+    if( status != kP3ReqReply || (id = P3IdentityLookup( MyComms, reply->dev_id )) == NULL )
+        return;
+
+    printf("%s: %s %s serial %s\n", ln->device,
+            id->manufacturer, id->product_name, id->serial_number );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Called after each run, report the slave coming and going                 */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3DaemonService( p3channel *ch )
+{
+    p3link      *ln = (p3link *)ch->context;
+
+    // commands from other processes, answered as closed once the link has gone
+    if( ln->shm != NULL )
+        P3ShmService( ln->shm, ch->MyComms );
+
+    // adapter unplugged
+    if( ch->closed )
+        {
+        if( !ln->closed )
+            printf("%s: closed\n", ln->device );
+        ln->closed = 1;
+        return;
+        }
+
+    if( (ln->slave->online != 0) != ln->online )
+        {
+        ln->online = (ln->slave->online != 0);
+        printf("%s: slave %s\n", ln->device, ln->online ? "online" : "offline" );
+
+        if( ln->online )
+            P3Request( ch->MyComms, &Cmd_Identify, CORTEX_DEVICE_ID, P3UserIdentifyDone, ln );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Worker thread, runs its own links only                                   */
+/*---------------------------------------------------------------------------*/
+
+static void *
+P3DaemonWorker( void *arg )
+{
+    p3worker    *w = (p3worker *)arg;
+    cpu_set_t    cpus;
+
+    // wakes from other threads are only skipped for this one
+    w->loop.thread = pthread_self();
+
+    // keep to one core so the channels stay in its cache
+    CPU_ZERO( &cpus );
+    CPU_SET( w->cpu, &cpus );
+    pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus );
+
+    while( !w->stop )
+        P3LoopOnce( &w->loop );
+
+    return( NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Remove the shared segments on the way out, from the main thread once a   */
+/*  signal has been taken                                                    */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3DaemonExit( void )
+{
+    int     i;
+
+    // the workers use the segments, let them finish first
+    for(i=0;i<workerCount;i++)
+        {
+        worker[i].stop = 1;
+        P3LoopWake( NULL, &worker[i].loop );
+        pthread_join( worker[i].thread, NULL );
+        }
+
+    for(i=0;i<linkCount;i++)
+        {
+        if( links[i].shm != NULL )
+            P3ShmDestroy( links[i].shm );
+        }
+
+    if( gatePath != NULL )
+        P3GateClose( &gate );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Open the links, share them out and check on them from the main thread    */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3link      *ln;
+    p3worker    *w;
+    p3comms     *MyComms;
+    p3engine     engine = kP3EngineEpoll;
+    int          debug = 0;
+    int          share = 0;
+    long         baud  = 230400;
+    char         name[64];
+    sigset_t     signals;
+    struct timespec period = { 5, 0 };
+    int          online;
+    int          status;
+    int          i;
+    int          c;
+
+    workerCount = sysconf( _SC_NPROCESSORS_ONLN );
+
+    while( (c = getopt( argc, argv, "dumg:b:t:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'd':   debug  = 1;                     break;
+            case 'u':   engine = kP3EngineUring;        break;
+            case 'm':   share  = 1;                     break;
+            case 'g':   gatePath = optarg;              break;
+            case 'b':   baud   = atol( optarg );        break;
+            case 't':   workerCount = atoi( optarg );   break;
+            default:
+                fprintf(stderr, "usage: %s [-d] [-u] [-m] [-g socket] [-b baud] [-t threads] device [device ...]\n", argv[0] );
+                return(1);
+            }
+        }
+
+    if( optind >= argc )
+        {
+        fprintf(stderr, "usage: %s [-d] [-u] [-m] [-g socket] [-b baud] [-t threads] device [device ...]\n", argv[0] );
+        return(1);
+        }
+
+    // each worker takes up to P3L_MAX_CHANNELS of them
+    if( (links = (p3link *)calloc( argc - optind, sizeof(p3link) )) == NULL )
+        {
+        perror("links");
+        return(1);
+        }
+
+    // no point in more workers than links
+    if( workerCount > argc - optind )
+        workerCount = argc - optind;
+    if( workerCount > P3D_MAX_WORKERS )
+        workerCount = P3D_MAX_WORKERS;
+    if( workerCount < 1 )
+        workerCount = 1;
+
+    for(i=0;i<workerCount;i++)
+        {
+        w = &worker[i];
+        w->cpu = i % sysconf( _SC_NPROCESSORS_ONLN );
+        if( P3LoopInit( &w->loop, engine ) != P3_SUCCESS )
+            {
+            perror("loop");
+            return(1);
+            }
+        }
+
+    if( gatePath != NULL && P3GateInit( &gate, gatePath ) != P3_SUCCESS )
+        {
+        perror( gatePath );
+        return(1);
+        }
+
+    for( ; optind < argc; optind++ )
+        {
+        if( (MyComms = P3Open( argv[optind], kP3ModeMaster, debug, baud )) == NULL )
+            {
+            perror( argv[optind] );
+            continue;
+            }
+
+        MyComms->DebugRx = debug;
+        MyComms->DebugTx = debug;
+
+        ln = &links[ linkCount ];
+        memset( ln, 0, sizeof(p3link) );
+        ln->device     = argv[optind];
+        ln->slave      = P3GetDevice( MyComms, CORTEX_DEVICE_ID );
+        ln->ch.service = P3DaemonService;
+        ln->ch.context = ln;
+
+        // probe the slave only when the link goes quiet, poll its motors
+        P3SetLiveness( MyComms, CORTEX_DEVICE_ID, P3_LIVENESS_QUIET );
+        P3ScheduleAdd( MyComms, CORTEX_DEVICE_ID, &Cmd_Motor_Status_Req, 10, 50, P3UserMotorStatusDone, ln );
+
+        // round robin over the workers
+        w = &worker[ linkCount % workerCount ];
+        if( P3LoopAdd( &w->loop, &ln->ch, MyComms ) != P3_SUCCESS )
+            {
+            fprintf(stderr, "%s: not opened, worker %d already has %d links, use -t\n",
+                    argv[optind], (int)(w - worker), w->loop.channelCount );
+            P3Deinit( MyComms );
+            continue;
+            }
+
+        // other processes reach the link through /dev/shm/p3-<device>
+        if( share )
+            {
+            snprintf( name, sizeof(name), "/p3-%s", basename( argv[optind] ) );
+            if( (ln->shm = P3ShmCreate( name, MyComms )) == NULL ||
+                P3LoopAddBell( &w->loop, ln->shm->bell, &ln->ch ) != P3_SUCCESS )
+                perror( name );
+            else
+                printf("%s: shared as %s\n", argv[optind], name );
+            }
+
+        // gateway records name the link by its index
+        if( gatePath != NULL )
+            {
+            if( P3GateAdd( &gate, &ln->ch ) == P3_SUCCESS )
+                printf("%s: link %d on %s\n", argv[optind], linkCount, gatePath );
+            else
+                fprintf(stderr, "%s: not on %s, the gateway is full\n", argv[optind], gatePath );
+            }
+
+        linkCount++;
+        }
+
+    if( linkCount == 0 )
+        return(1);
+
+    // no handler, the threads started below inherit the mask and the main
+    // thread takes the signal with sigtimedwait
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &signals, NULL );
+
+    for(i=0;i<workerCount;i++)
+        {
+        if( pthread_create( &worker[i].thread, NULL, P3DaemonWorker, &worker[i] ) != 0 )
+            {
+            perror("pthread");
+            return(1);
+            }
+        }
+
+    if( gatePath != NULL && P3GateStart( &gate ) != P3_SUCCESS )
+        {
+        perror("gateway");
+        return(1);
+        }
+
+    // check each slave answers a request from outside its worker
+    while( 1 )
+        {
+        if( sigtimedwait( &signals, NULL, &period ) > 0 )
+            break;
+
+        online = 0;
+        for(i=0;i<linkCount;i++)
+            {
+            ln = &links[i];
+            if( ln->ch.closed || !ln->online )
+                continue;
+
+            status = P3Transact( ln->ch.MyComms, &Cmd_Dev_Type, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+            if( status == kP3ReqReply )
+                online++;
+            else
+                printf("%s: no reply to device type\n", ln->device );
+            }
+
+        printf("%d of %d slaves answering\n", online, linkCount );
+        for(i=0;i<workerCount;i++)
+            printf("  worker %d cpu %d channels %d runs %lu waits %lu dropped %lu\n", i, worker[i].cpu,
+                    worker[i].loop.channelCount, worker[i].loop.runs, worker[i].loop.waits,
+                    worker[i].loop.dropped );
+        if( gatePath != NULL )
+            printf("  gateway batches in %lu out %lu replies %lu\n",
+                    gate.batchesIn, gate.batchesOut, gate.frames );
+        }
+
+    P3DaemonExit();
+
+    return(0);
+}
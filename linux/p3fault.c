@@ -0,0 +1,347 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3fault.c                                                    */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    How the protocol copes with line noise, see P3UartFaults                 */
+/*                                                                             */
+/*    A master and slave on a virtual line, as p3vuart, with the master        */
+/*    sending echo requests back to back.  Each echo carries a sequence        */
+/*    number and pattern so a reply that passed the checksum but differs from  */
+/*    what was sent is a false accept.  Resync is the time from the first      */
+/*    fault on a direction to the next frame the receiver accepts.  One run    */
+/*    for each bit error rate given.                                           */
+/*                                                                             */
+/*    usage: p3fault [-n] [-b baud] [-e bers] [-B burst,len] [-D drop]         */
+/*                   [-U dup] [-P preamble] [-S every,for] [-r seed]           */
+/*                   [-s seconds]                                              */
+/*    -n no parity, -B -D -U and -P are chances for each byte                  */
+/*    -S line sticks for the second time in mS, about every first time         */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3uart.h"
+
+// bit error rates one run can sweep over
+#define P3F_MAX_BERS        16
+
+// echo, the slave sends the data straight back
+#define CMD2_STATUS_ECHO    0x30
+
+static  p3uart      uart;
+static  p3cmd       echo;       // request in flight
+static  p3cmd       Cmd_Echo_Reply  = { CMD1_GROUP_STATUS_REPLY, CMD2_STATUS_ECHO, 0, {0} };
+
+static  unsigned long   seq;
+static  unsigned long   good;
+static  unsigned long   goodBytes;
+static  unsigned long   naks;
+static  unsigned long   timeouts;
+static  unsigned long   falseAccepts;
+static  unsigned long   stale;
+static  unsigned long   resyncs;
+static  long long       resyncSum;
+static  long long       resyncMax;
+
+/*---------------------------------------------------------------------------*/
+/*  Master - the next echo, length and pattern change with the sequence      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3FaultSend( p3comms *MyComms );
+
+static void
+P3FaultFill( p3cmd *cmd, unsigned long n )
+{
+    int     i;
+
+    cmd->cmd1   = CMD1_GROUP_STATUS;
+    cmd->cmd2   = CMD2_STATUS_ECHO;
+    cmd->length = 4 + (n * 7) % (P3_SMALL_MSG - 3);
+
+    memcpy( cmd->data, &n, 4 );
+    for(i=4;i<cmd->length;i++)
+        cmd->data[i] = (unsigned char)(n * 31 + i * 17);
+}
+
+void
+P3FaultDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3cmdfull       *cmd;
+    p3cmd            was;
+    unsigned long    n = 0;
+
+    (void)context;
+
+    if( status == kP3ReqReply )
+        {
+        cmd = &reply->command.cmdpak.cmd;
+        if( cmd->length >= 4 )
+            memcpy( &n, cmd->data, 4 );
+        P3FaultFill( &was, n );
+
+        // passed the checksum, is it what was sent
+        if( reply->masked_cmd1 != CMD1_GROUP_STATUS_REPLY || cmd->cmd2 != CMD2_STATUS_ECHO ||
+            cmd->length != was.length || memcmp( cmd->data, was.data, was.length ) != 0 )
+            falseAccepts++;
+        else
+        if( n != seq )
+            stale++;        // late reply to an earlier request that timed out
+        else
+            {
+            good++;
+            goodBytes += was.length;
+            }
+        }
+    else
+    if( status == kP3ReqNak )
+        naks++;
+    else
+        timeouts++;
+
+    P3FaultSend( MyComms );
+}
+
+static void
+P3FaultSend( p3comms *MyComms )
+{
+    P3FaultFill( &echo, ++seq );
+    P3Request( MyComms, &echo, CORTEX_DEVICE_ID, P3FaultDone, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave - echo the data back                                               */
+/*---------------------------------------------------------------------------*/
+
+int
+P3FaultDecodeSlave( p3comms *MyComms, p3pak *packet )
+{
+    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
+
+    if( packet->masked_cmd1 != CMD1_GROUP_STATUS || cmd->cmd2 != CMD2_STATUS_ECHO ||
+        cmd->length > P3_SMALL_MSG )
+        return(0);
+
+    Cmd_Echo_Reply.length = cmd->length;
+    memcpy( Cmd_Echo_Reply.data, cmd->data, cmd->length );
+    P3Command( MyComms, &Cmd_Echo_Reply, packet->dev_id );
+
+    return(1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Either end - a frame passed the checksum, the receiver is back in step   */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3FaultMonitor( p3comms *MyComms, p3pak *packet, void *context )
+{
+    p3uartdir   *d = (p3uartdir *)context;
+    long long    t;
+
+    (void)MyComms;
+    (void)packet;
+
+    if( d->faultAt < 0 )
+        return;
+
+    t = uart.now - d->faultAt;
+    d->faultAt = -1;
+
+    resyncs++;
+    resyncSum += t;
+    if( t > resyncMax )
+        resyncMax = t;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run one end for the whole ticks since it last ran, as p3loop does        */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3FaultRun( p3comms *MyComms, long long *last, long long now )
+{
+    long    elapsed;
+
+    elapsed  = (long)((now - *last) / (P3_TICK_US * 1000LL));
+    *last   += (long long)elapsed * P3_TICK_US * 1000LL;
+
+    P3CommsRun( MyComms, elapsed );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  One run at one set of faults                                             */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3FaultRunOnce( p3uartcfg *cfg, p3uartfault *fault, long long end )
+{
+    p3comms     *master;
+    p3comms     *slave;
+    long long    tick = P3_TICK_US * 1000LL;
+    long long    masterNext = 0, masterLast = 0;
+    long long    slaveNext = tick / 2, slaveLast = tick / 2;
+
+    seq = good = goodBytes = naks = timeouts = falseAccepts = stale = resyncs = 0;
+    resyncSum = resyncMax = 0;
+
+    P3UartInit( &uart, cfg );
+    P3UartFaults( &uart, fault );
+
+    master = P3UartOpen( &uart, 0, kP3ModeMaster, 0 );
+    slave  = P3UartOpen( &uart, 1, kP3ModeSlave,  0 );
+    if( master == NULL || slave == NULL )
+        exit(1);
+
+    P3SetAddress( slave, CORTEX_DEVICE_ID );
+    P3SetReplyDecoder( slave, P3FaultDecodeSlave );
+
+    // each end watches what the other sends it
+    P3SetMonitor( master, P3FaultMonitor, &uart.dir[1] );
+    P3SetMonitor( slave,  P3FaultMonitor, &uart.dir[0] );
+
+    P3FaultSend( master );
+
+    while( uart.now < end )
+        {
+        if( masterNext <= slaveNext )
+            {
+            P3UartAdvance( &uart, masterNext );
+            P3FaultRun( master, &masterLast, masterNext );
+            masterNext += tick;
+            }
+        else
+            {
+            P3UartAdvance( &uart, slaveNext );
+            P3FaultRun( slave, &slaveLast, slaveNext );
+            slaveNext += tick;
+            }
+        }
+
+    P3Deinit( master );
+    P3Deinit( slave );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run each bit error rate and report                                       */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3uartcfg    cfg;
+    p3uartfault  fault;
+    double       bers[ P3F_MAX_BERS ] = { 0, 1e-5, 1e-4, 1e-3, 1e-2 };
+    int          nbers = 5;
+    long long    seconds = 60;
+    unsigned long accepted;
+    unsigned long sent;
+    unsigned long bytes;
+    p3uartdir   *d;
+    char        *p;
+    int          i;
+    int          c;
+
+    memset( &cfg, 0, sizeof(cfg) );
+    cfg.baud   = 230400;
+    cfg.parity = 1;
+    cfg.txFifo = 256;
+    cfg.rxFifo = 256;
+
+    memset( &fault, 0, sizeof(fault) );
+    fault.seed = 1;
+
+    while( (c = getopt( argc, argv, "nb:e:B:D:U:P:S:r:s:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'n':   cfg.parity = 0;                             break;
+            case 'b':   cfg.baud   = atol( optarg );                break;
+            case 'e':
+                for( nbers = 0, p = strtok( optarg, "," ); p != NULL && nbers < P3F_MAX_BERS; p = strtok( NULL, "," ) )
+                    bers[ nbers++ ] = atof( p );
+                break;
+            case 'B':
+                fault.burst = atof( optarg );
+                fault.burstLen = (p = strchr( optarg, ',' )) ? atoi( p + 1 ) : 4;
+                break;
+            case 'D':   fault.drop     = atof( optarg );            break;
+            case 'U':   fault.dup      = atof( optarg );            break;
+            case 'P':   fault.preamble = atof( optarg );            break;
+            case 'S':
+                fault.stuckEvery = atoll( optarg ) * 1000000LL;
+                fault.stuckFor   = (p = strchr( optarg, ',' )) ? atoll( p + 1 ) * 1000000LL : 10000000LL;
+                break;
+            case 'r':   fault.seed = strtoull( optarg, NULL, 0 );   break;
+            case 's':   seconds    = atoll( optarg );               break;
+            default:
+                fprintf(stderr, "usage: %s [-n] [-b baud] [-e bers] [-B burst,len] [-D drop]\n", argv[0] );
+                fprintf(stderr, "       [-U dup] [-P preamble] [-S every,for] [-r seed] [-s seconds]\n" );
+                return(1);
+            }
+        }
+
+    if( cfg.baud <= 0 || seconds <= 0 )
+        return(1);
+
+    printf("baud %ld, %d bits, burst %g x %d, drop %g, dup %g, preamble %g, stuck %lld mS every %lld mS, %lld S each\n",
+            cfg.baud, cfg.parity ? 11 : 10, fault.burst, fault.burstLen, fault.drop, fault.dup,
+            fault.preamble, fault.stuckFor / 1000000, fault.stuckEvery / 1000000, seconds );
+    printf("     ber  goodput B/s  frames ok    lost  lost %%  stale  false  per 1e6  resync mS mean    max  bytes bad/rejected\n");
+
+    for(i=0;i<nbers;i++)
+        {
+        fault.ber = bers[i];
+        P3FaultRunOnce( &cfg, &fault, seconds * 1000000000LL );
+
+        sent     = good + naks + timeouts + falseAccepts + stale;
+        accepted = good + falseAccepts + stale;
+        bytes    = 0;
+        for(c=0;c<2;c++)
+            {
+            d = &uart.dir[c];
+            bytes += d->corrupted + d->vanished + d->doubled + d->inserted + d->stuck;
+            }
+
+        printf("%8.0e %12.1f %10lu %7lu %6.2f%% %6lu %6lu %8.1f %15.2f %6.2f  %lu/%lu\n",
+                fault.ber, goodBytes / (double)seconds, good, naks + timeouts,
+                sent ? (naks + timeouts) * 100.0 / sent : 0.0,
+                stale, falseAccepts, accepted ? falseAccepts * 1e6 / accepted : 0.0,
+                resyncs ? resyncSum / 1e6 / resyncs : 0.0, resyncMax / 1e6,
+                bytes, uart.dir[0].rejected + uart.dir[1].rejected );
+        }
+
+    return(0);
+}
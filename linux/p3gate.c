@@ -0,0 +1,903 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3gate.c                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Unix domain socket gateway to the links of a daemon                      */
+/*                                                                             */
+/*    For tools that cannot map the shared segments.  Requests and replies     */
+/*    travel in batches, a header giving the length and record count then      */
+/*    the records, so a client pays one system call for a batch rather than    */
+/*    one per frame.  Batches larger than P3G_INLINE_MAX are written to a      */
+/*    memfd and only the header and the fd, SCM_RIGHTS, go down the socket.    */
+/*    The memfd must be sealed against shrinking before the daemon maps it.    */
+/*                                                                             */
+/*    The gateway has its own thread.  It hands requests to P3Request and      */
+/*    the workers hand the replies back on a list, with one eventfd write      */
+/*    for however many finish before the gateway next runs.  A client whose    */
+/*    requests do not fit waits until earlier ones finish and is not read      */
+/*    until then.                                                              */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE     // for memfd_create and accept4
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3loop.h"
+#include "p3gate.h"
+
+// epoll tags other than the client index
+#define P3G_TAG_LISTEN      P3G_MAX_CLIENTS
+#define P3G_TAG_WAKE        (P3G_MAX_CLIENTS + 1)
+
+// replies one client can have waiting
+#define P3G_OUT_SIZE        (P3G_REQUESTS * sizeof(p3gaterec))
+
+/*---------------------------------------------------------------------------*/
+/*  Records - add one to a batch, returns the bytes used                     */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GatePut( unsigned char *buf, p3gaterec *rec )
+{
+    int     len = P3G_REC_FIXED + rec->cmd.length;
+
+    memcpy( buf, rec, len );
+
+    return( len );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Records - take one from a batch, returns the bytes used or -1 if the     */
+/*  batch is short or the record is bad                                      */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateGet( unsigned char *buf, int avail, p3gaterec *rec )
+{
+    int     len;
+
+    if( avail < (int)P3G_REC_FIXED )
+        return( -1 );
+
+    // cmd.length is the last byte of the fixed part
+    if( buf[ P3G_REC_FIXED - 1 ] > P3_FULL_MSG )
+        return( -1 );
+
+    len = P3G_REC_FIXED + buf[ P3G_REC_FIXED - 1 ];
+    if( avail < len )
+        return( -1 );
+
+    memcpy( rec, buf, len );
+
+    return( len );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Send a batch, through a memfd if it is large.  The socket should be      */
+/*  blocking, partial writes are finished here                               */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateSend( int fd, unsigned char *buf, int length, int count )
+{
+    p3gatehdr       hdr;
+    struct iovec    iov[2];
+    struct msghdr   msg;
+    struct cmsghdr *cm;
+    union {
+        struct cmsghdr  h;
+        char            space[ CMSG_SPACE( sizeof(int) ) ];
+        } ctl;
+    int             mfd = -1;
+    int             total;
+    int             sent = 0;
+    int             n;
+
+    hdr.length = length;
+    hdr.count  = count;
+    hdr.flags  = 0;
+
+    memset( &msg, 0, sizeof(msg) );
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len  = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = length;
+    msg.msg_iov     = iov;
+    msg.msg_iovlen  = 2;
+
+    // bulk goes in a memfd, the socket carries the header and the fd
+    if( length > P3G_INLINE_MAX )
+        {
+        if( (mfd = memfd_create( "p3gate", MFD_CLOEXEC | MFD_ALLOW_SEALING )) < 0 )
+            return( P3_FAILURE );
+
+        // sealed so the daemon can map it without fear of it shrinking
+        if( write( mfd, buf, length ) != length ||
+            fcntl( mfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) < 0 )
+            {
+            close( mfd );
+            return( P3_FAILURE );
+            }
+
+        hdr.flags          = P3G_MEMFD;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = &ctl;
+        msg.msg_controllen = sizeof(ctl.space);
+
+        cm = CMSG_FIRSTHDR( &msg );
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type  = SCM_RIGHTS;
+        cm->cmsg_len   = CMSG_LEN( sizeof(int) );
+        memcpy( CMSG_DATA( cm ), &mfd, sizeof(int) );
+        }
+
+    total = iov[0].iov_len + (msg.msg_iovlen > 1 ? (int)iov[1].iov_len : 0);
+
+    while( sent < total )
+        {
+        if( (n = sendmsg( fd, &msg, MSG_NOSIGNAL )) < 0 )
+            {
+            if( errno == EINTR )
+                continue;
+            break;
+            }
+        sent += n;
+
+        // the fd went with the first byte, step over what was sent
+        msg.msg_control    = NULL;
+        msg.msg_controllen = 0;
+        while( n > 0 )
+            {
+            if( n >= (int)msg.msg_iov->iov_len )
+                {
+                n -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+                }
+            else
+                {
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+                msg.msg_iov->iov_len -= n;
+                n = 0;
+                }
+            }
+        }
+
+    if( mfd >= 0 )
+        close( mfd );
+
+    return( sent == total ? P3_SUCCESS : P3_FAILURE );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Receive bytes and keep any fds that came with them                       */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3GateRecvMsg( int fd, void *buf, int len, int *fds, int *fdCount, int max, int flags )
+{
+    struct iovec    iov;
+    struct msghdr   msg;
+    struct cmsghdr *cm;
+    union {
+        struct cmsghdr  h;
+        char            space[ CMSG_SPACE( 4 * sizeof(int) ) ];
+        } ctl;
+    int             n;
+    int             f;
+    int             i;
+
+    memset( &msg, 0, sizeof(msg) );
+    iov.iov_base       = buf;
+    iov.iov_len        = len;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = &ctl;
+    msg.msg_controllen = sizeof(ctl.space);
+
+    if( (n = recvmsg( fd, &msg, flags | MSG_CMSG_CLOEXEC )) <= 0 )
+        return( n );
+
+    for( cm = CMSG_FIRSTHDR( &msg ); cm != NULL; cm = CMSG_NXTHDR( &msg, cm ) )
+        {
+        if( cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS )
+            continue;
+
+        for(i=0;i<(int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));i++)
+            {
+            memcpy( &f, CMSG_DATA( cm ) + i * sizeof(int), sizeof(int) );
+            if( *fdCount < max )
+                fds[ (*fdCount)++ ] = f;
+            else
+                close( f );
+            }
+        }
+
+    return( n );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - a request finished, runs on the worker that owns the link       */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3gatereq          *req  = (p3gatereq *)context;
+    p3gate             *gate = req->gate;
+    unsigned long long  one  = 1;
+    int                 wake;
+
+    (void)MyComms;
+
+    req->rec.status = status;
+    req->rec.valid  = (reply != NULL);
+    if( reply != NULL )
+        {
+        req->rec.dev_id = reply->dev_id;
+        memcpy( &req->rec.cmd, &reply->command.cmdpak.cmd, 3 );
+        if( req->rec.cmd.length > P3_FULL_MSG )
+            req->rec.cmd.length = P3_FULL_MSG;
+        memcpy( req->rec.cmd.data, reply->command.cmdpak.cmd.data, req->rec.cmd.length );
+        }
+    else
+        req->rec.cmd.length = 0;
+
+    pthread_mutex_lock( &gate->lock );
+    req->next  = gate->done;
+    gate->done = req;
+    wake = !gate->woken;
+    gate->woken = 1;
+    pthread_mutex_unlock( &gate->lock );
+
+    // one wake up for however many replies finish before the gateway runs
+    if( wake && write( gate->efd, &one, sizeof(one) ) < 0 )
+        return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - send the replies waiting for a client as one batch              */
+/*---------------------------------------------------------------------------*/
+
+static void P3GateDrop( p3gate *gate, p3gateclient *c );
+
+static void
+P3GateFlush( p3gate *gate, p3gateclient *c )
+{
+    if( c->outCount == 0 )
+        return;
+
+    if( P3GateSend( c->fd, c->out, c->outLen, c->outCount ) != P3_SUCCESS )
+        {
+        P3GateDrop( gate, c );
+        return;
+        }
+
+    gate->batchesOut++;
+    gate->frames += c->outCount;
+    c->outLen   = 0;
+    c->outCount = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - queue a reply for its client and free the request               */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateAppend( p3gate *gate, p3gatereq *req )
+{
+    p3gateclient   *c = &gate->client[ req->client ];
+
+    // dropped if the client went away while the request was in flight
+    if( c->fd >= 0 && c->gen == req->gen )
+        {
+        if( c->outLen + sizeof(p3gaterec) > P3G_OUT_SIZE )
+            P3GateFlush( gate, c );
+        if( c->fd >= 0 )
+            {
+            c->outLen += P3GatePut( c->out + c->outLen, &req->rec );
+            c->outCount++;
+            }
+        }
+
+    req->next  = gate->free;
+    gate->free = req;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - collect the replies the workers finished                        */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateCollect( p3gate *gate )
+{
+    p3gatereq   *req;
+    p3gatereq   *next;
+    p3gatereq   *list = NULL;
+
+    pthread_mutex_lock( &gate->lock );
+    req = gate->done;
+    gate->done  = NULL;
+    gate->woken = 0;
+    pthread_mutex_unlock( &gate->lock );
+
+    // back into the order they finished
+    for( ; req != NULL; req = next )
+        {
+        next = req->next;
+        req->next = list;
+        list = req;
+        }
+
+    for( req = list; req != NULL; req = next )
+        {
+        next = req->next;
+        gate->inflight[ req->rec.link ]--;
+        P3GateAppend( gate, req );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - submit what is left of the current batch.  Returns 1 when the   */
+/*  batch is done, 0 if out of requests or the link is busy and -1 for a     */
+/*  bad record                                                               */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3GateSubmit( p3gate *gate, p3gateclient *c )
+{
+    p3gatereq   *req;
+    p3channel   *ch;
+    int          n;
+
+    while( c->batchLeft > 0 )
+        {
+        if( (req = gate->free) == NULL )
+            return( 0 );
+
+        if( (n = P3GateGet( c->batch + c->batchPos, c->batchLen - c->batchPos, &req->rec )) < 0 )
+            return( -1 );
+
+        req->client = c - gate->client;
+        req->gen    = c->gen;
+
+        ch = (req->rec.link < gate->linkCount) ? gate->link[ req->rec.link ] : NULL;
+        if( ch == NULL || ch->closed || req->rec.cmd.length > P3_SMALL_MSG )
+            {
+            // answered straight away
+            req->rec.status     = (ch == NULL || ch->closed) ? P3G_NO_LINK : P3G_TOO_LONG;
+            req->rec.valid      = 0;
+            req->rec.cmd.length = 0;
+            gate->free = req->next;
+            P3GateAppend( gate, req );
+            if( c->fd < 0 )
+                return( -1 );
+            }
+        else
+            {
+            if( gate->inflight[ req->rec.link ] >= P3G_LINK_DEPTH ||
+                P3Request( ch->MyComms, &req->rec.cmd, req->rec.dev_id, P3GateDone, req ) != P3_SUCCESS )
+                return( 0 );
+            gate->inflight[ req->rec.link ]++;
+            gate->free = req->next;
+            }
+
+        c->batchPos += n;
+        c->batchLeft--;
+        }
+
+    return( 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - take complete batches from what the client has sent             */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3GateParse( p3gate *gate, p3gateclient *c )
+{
+    p3gatehdr   hdr;
+    struct stat st;
+    int         seals;
+    int         status;
+
+    while( 1 )
+        {
+        if( c->batch != NULL )
+            {
+            if( (status = P3GateSubmit( gate, c )) < 0 )
+                return( P3_FAILURE );
+            if( status == 0 )
+                return( P3_SUCCESS );
+
+            // batch done
+            if( c->map != NULL )
+                {
+                munmap( c->map, c->batchLen );
+                c->map = NULL;
+                }
+            else
+                {
+                c->inLen -= sizeof(hdr) + c->batchLen;
+                memmove( c->in, c->in + sizeof(hdr) + c->batchLen, c->inLen );
+                }
+            c->batch = NULL;
+            }
+
+        if( c->inLen < (int)sizeof(hdr) )
+            return( P3_SUCCESS );
+        memcpy( &hdr, c->in, sizeof(hdr) );
+
+        if( hdr.flags & P3G_MEMFD )
+            {
+            // the fd came with the header
+            if( c->fdCount == 0 || hdr.length == 0 || hdr.length > P3G_BATCH_MAX )
+                return( P3_FAILURE );
+
+            // a file the client could still resize would fault the mapping,
+            // F_GET_SEALS fails on anything that is not a memfd
+            if( fstat( c->fds[0], &st ) < 0 || st.st_size < (off_t)hdr.length ||
+                (seals = fcntl( c->fds[0], F_GET_SEALS )) < 0 ||
+                (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW) )
+                return( P3_FAILURE );
+
+            c->map = mmap( NULL, hdr.length, PROT_READ, MAP_PRIVATE, c->fds[0], 0 );
+            close( c->fds[0] );
+            c->fdCount--;
+            memmove( &c->fds[0], &c->fds[1], c->fdCount * sizeof(int) );
+            if( c->map == MAP_FAILED )
+                {
+                c->map = NULL;
+                return( P3_FAILURE );
+                }
+
+            c->inLen -= sizeof(hdr);
+            memmove( c->in, c->in + sizeof(hdr), c->inLen );
+            c->batch = c->map;
+            }
+        else
+            {
+            if( hdr.length > P3G_INLINE_MAX )
+                return( P3_FAILURE );
+            if( c->inLen < (int)(sizeof(hdr) + hdr.length) )
+                return( P3_SUCCESS );
+            c->batch = c->in + sizeof(hdr);
+            }
+
+        c->batchLen  = hdr.length;
+        c->batchPos  = 0;
+        c->batchLeft = hdr.count;
+        gate->batchesIn++;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - close a client, replies still in flight are dropped             */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateDrop( p3gate *gate, p3gateclient *c )
+{
+    (void)gate;
+
+    if( c->fd >= 0 )
+        close( c->fd );
+    if( c->map != NULL )
+        munmap( c->map, c->batchLen );
+    while( c->fdCount > 0 )
+        close( c->fds[ --c->fdCount ] );
+
+    free( c->out );
+
+    c->fd        = -1;
+    c->map       = NULL;
+    c->batch     = NULL;
+    c->batchLeft = 0;
+    c->inLen     = 0;
+    c->out       = NULL;
+    c->outLen    = 0;
+    c->outCount  = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - read until the socket is empty, sockets are edge triggered      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateRead( p3gate *gate, p3gateclient *c )
+{
+    int     n;
+
+    while( c->fd >= 0 )
+        {
+        if( P3GateParse( gate, c ) != P3_SUCCESS )
+            {
+            P3GateDrop( gate, c );
+            return;
+            }
+
+        // stalled, read again once requests finish
+        if( c->batch != NULL )
+            return;
+
+        n = P3GateRecvMsg( c->fd, c->in + c->inLen, sizeof(c->in) - c->inLen,
+                           c->fds, &c->fdCount, 8, MSG_DONTWAIT );
+        if( n > 0 )
+            c->inLen += n;
+        else
+        if( n < 0 && errno == EINTR )
+            continue;
+        else
+        if( n < 0 && errno == EAGAIN )
+            return;
+        else
+            P3GateDrop( gate, c );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - accept new clients                                              */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3GateAccept( p3gate *gate )
+{
+    p3gateclient       *c;
+    struct epoll_event  ev;
+    struct timeval      tv = { 1, 0 };
+    int                 fd;
+    int                 i;
+
+    while( (fd = accept4( gate->listen, NULL, NULL, SOCK_CLOEXEC )) >= 0 )
+        {
+        for(i=0;i<P3G_MAX_CLIENTS;i++)
+            if( gate->client[i].fd < 0 )
+                break;
+
+        c = &gate->client[i];
+        if( i == P3G_MAX_CLIENTS || (c->out = malloc( P3G_OUT_SIZE )) == NULL )
+            {
+            close( fd );
+            continue;
+            }
+
+        // replies are sent blocking, a client that stops reading is dropped
+        setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+
+        c->fd = fd;
+        c->gen++;
+
+        ev.events   = EPOLLIN | EPOLLET;
+        ev.data.u32 = i;
+        if( epoll_ctl( gate->epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+            P3GateDrop( gate, c );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - gateway thread                                                  */
+/*---------------------------------------------------------------------------*/
+
+static void *
+P3GateThread( void *arg )
+{
+    p3gate             *gate = (p3gate *)arg;
+    p3gateclient       *c;
+    struct epoll_event  ev[ 64 ];
+    unsigned long long  count;
+    int                 stalled = 0;
+    int                 n;
+    int                 i;
+
+    while( 1 )
+        {
+        // a stalled client may be waiting on a submit queue the gateway did
+        // not fill, so look again shortly even without a reply
+        n = epoll_wait( gate->epfd, ev, 64, stalled ? 10 : -1 );
+
+        for(i=0;i<n;i++)
+            {
+            if( ev[i].data.u32 == P3G_TAG_LISTEN )
+                P3GateAccept( gate );
+            else
+            if( ev[i].data.u32 == P3G_TAG_WAKE )
+                {
+                if( read( gate->efd, &count, sizeof(count) ) < 0 )
+                    continue;
+                }
+            else
+                P3GateRead( gate, &gate->client[ ev[i].data.u32 ] );
+            }
+
+        P3GateCollect( gate );
+
+        // requests have been freed, carry on with stalled batches
+        stalled = 0;
+        for(i=0;i<P3G_MAX_CLIENTS;i++)
+            {
+            c = &gate->client[i];
+            if( c->fd >= 0 && c->batch != NULL )
+                P3GateRead( gate, c );
+            if( c->fd >= 0 && c->batch != NULL )
+                stalled++;
+
+            P3GateFlush( gate, c );
+            }
+        }
+
+    return( NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - listen on path, links are added before the thread starts        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateInit( p3gate *gate, char *path )
+{
+    struct sockaddr_un  addr;
+    struct epoll_event  ev;
+    int                 i;
+
+    memset( gate, 0, sizeof(p3gate) );
+    gate->listen = -1;
+    gate->efd    = -1;
+    gate->epfd   = -1;
+    pthread_mutex_init( &gate->lock, NULL );
+
+    for(i=0;i<P3G_MAX_CLIENTS;i++)
+        gate->client[i].fd = -1;
+    for(i=0;i<P3G_REQUESTS;i++)
+        {
+        gate->req[i].gate = gate;
+        gate->req[i].next = gate->free;
+        gate->free = &gate->req[i];
+        }
+
+    if( strlen( path ) >= sizeof(addr.sun_path) )
+        {
+        errno = ENAMETOOLONG;
+        return( P3_FAILURE );
+        }
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, path );
+    strcpy( gate->path, path );
+
+    // left over from a daemon that did not exit cleanly
+    unlink( path );
+
+    if( (gate->listen = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 )) < 0 ||
+        bind( gate->listen, (struct sockaddr *)&addr, sizeof(addr) ) < 0 ||
+        listen( gate->listen, 16 ) < 0 )
+        return( P3_FAILURE );
+
+    if( (gate->efd  = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC )) < 0 ||
+        (gate->epfd = epoll_create1( EPOLL_CLOEXEC )) < 0 )
+        return( P3_FAILURE );
+
+    ev.events   = EPOLLIN;
+    ev.data.u32 = P3G_TAG_LISTEN;
+    if( epoll_ctl( gate->epfd, EPOLL_CTL_ADD, gate->listen, &ev ) < 0 )
+        return( P3_FAILURE );
+    ev.data.u32 = P3G_TAG_WAKE;
+    if( epoll_ctl( gate->epfd, EPOLL_CTL_ADD, gate->efd, &ev ) < 0 )
+        return( P3_FAILURE );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - add a link, records name it by the order it was added           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateAdd( p3gate *gate, p3channel *ch )
+{
+    if( gate->linkCount >= 256 )
+        return( P3_FAILURE );
+
+    gate->link[ gate->linkCount++ ] = ch;
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - start the gateway thread                                        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateStart( p3gate *gate )
+{
+    if( pthread_create( &gate->thread, NULL, P3GateThread, gate ) != 0 )
+        return( P3_FAILURE );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - remove the socket, safe from a signal handler                   */
+/*---------------------------------------------------------------------------*/
+
+void
+P3GateClose( p3gate *gate )
+{
+    if( gate->listen >= 0 )
+        close( gate->listen );
+
+    unlink( gate->path );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - connect to a gateway                                            */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateConnect( char *path )
+{
+    struct sockaddr_un  addr;
+    int                 fd;
+
+    if( strlen( path ) >= sizeof(addr.sun_path) )
+        {
+        errno = ENAMETOOLONG;
+        return( -1 );
+        }
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, path );
+
+    if( (fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 )
+        return( -1 );
+
+    if( connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0 )
+        {
+        close( fd );
+        return( -1 );
+        }
+
+    return( fd );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - read exactly len bytes, the first fd that comes with them is    */
+/*  returned in mfd                                                          */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3GateReadAll( int fd, void *buf, int len, int *mfd )
+{
+    int     fds[4];
+    int     fdCount = 0;
+    int     got = 0;
+    int     n;
+
+    while( got < len )
+        {
+        if( (n = P3GateRecvMsg( fd, (char *)buf + got, len - got, fds, &fdCount, 4, 0 )) < 0 && errno == EINTR )
+            continue;
+        if( n <= 0 )
+            break;
+        got += n;
+        }
+
+    for(n=0;n<fdCount;n++)
+        {
+        if( n == 0 && mfd != NULL )
+            *mfd = fds[0];
+        else
+            close( fds[n] );
+        }
+
+    return( got == len ? P3_SUCCESS : P3_FAILURE );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - wait for the next batch, records are read with P3GateGet        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3GateRecv( int fd, p3gatebatch *batch )
+{
+    p3gatehdr   hdr;
+    int         mfd = -1;
+
+    batch->map = NULL;
+
+    if( P3GateReadAll( fd, &hdr, sizeof(hdr), &mfd ) != P3_SUCCESS )
+        {
+        if( mfd >= 0 )
+            close( mfd );
+        return( P3_FAILURE );
+        }
+
+    batch->length = hdr.length;
+    batch->count  = hdr.count;
+
+    if( hdr.flags & P3G_MEMFD )
+        {
+        if( mfd < 0 || hdr.length == 0 || hdr.length > P3G_BATCH_MAX )
+            {
+            if( mfd >= 0 )
+                close( mfd );
+            return( P3_FAILURE );
+            }
+
+        batch->map = mmap( NULL, hdr.length, PROT_READ, MAP_PRIVATE, mfd, 0 );
+        close( mfd );
+        if( batch->map == MAP_FAILED )
+            {
+            batch->map = NULL;
+            return( P3_FAILURE );
+            }
+        batch->data = batch->map;
+
+        return( P3_SUCCESS );
+        }
+
+    if( mfd >= 0 )
+        close( mfd );
+    if( hdr.length > P3G_INLINE_MAX )
+        return( P3_FAILURE );
+
+    batch->data = batch->buf;
+
+    return( P3GateReadAll( fd, batch->buf, hdr.length, NULL ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - finished with a batch                                           */
+/*---------------------------------------------------------------------------*/
+
+void
+P3GateRelease( p3gatebatch *batch )
+{
+    if( batch->map != NULL )
+        munmap( batch->map, batch->length );
+
+    batch->map = NULL;
+}
@@ -0,0 +1,170 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3gate.h                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Header for p3gate.c                                                      */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#ifndef P3GATE_H_
+#define P3GATE_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+// clients connected to the gateway
+#ifndef P3G_MAX_CLIENTS
+#define P3G_MAX_CLIENTS     32
+#endif
+// requests in flight from all clients
+#ifndef P3G_REQUESTS
+#define P3G_REQUESTS        256
+#endif
+// requests in flight on one link, leaves room in its submit queue for others
+#ifndef P3G_LINK_DEPTH
+#define P3G_LINK_DEPTH      (P3_SUBMIT_QUEUE_SIZE / 2)
+#endif
+// larger batches are sent in a memfd
+#ifndef P3G_INLINE_MAX
+#define P3G_INLINE_MAX      16384
+#endif
+// largest batch accepted in a memfd
+#ifndef P3G_BATCH_MAX
+#define P3G_BATCH_MAX       (1 << 20)
+#endif
+
+// batch flags
+#define P3G_MEMFD           0x0001  // records are in a memfd passed with the header
+
+// reply status for records the gateway could not submit
+#define P3G_NO_LINK         0xFF    // the daemon has no such link
+#define P3G_TOO_LONG        0xFE    // command longer than P3_SMALL_MSG
+
+// batch header, length bytes of records follow unless they are in a memfd
+typedef struct _p3gatehdr {
+    unsigned int            length;
+    unsigned short          count;
+    unsigned short          flags;
+    } p3gatehdr;
+
+// one request or reply, only cmd.length bytes of cmd.data are sent
+typedef struct _p3gaterec {
+    unsigned int            id;         // chosen by the client, returned with the reply
+    unsigned char           link;       // daemon link, in the order they were opened
+    unsigned char           dev_id;     // request destination, reply source
+    unsigned char           status;     // reply p3reqstatus, P3G_NO_LINK or P3G_TOO_LONG
+    unsigned char           valid;      // reply cmd holds a frame
+    p3cmdfull               cmd;
+    } p3gaterec;
+
+#define P3G_REC_FIXED       offsetof(p3gaterec, cmd.data)
+
+// batch received by a client
+typedef struct _p3gatebatch {
+    unsigned char          *data;
+    int                     length;
+    int                     count;
+    unsigned char          *map;        // memfd mapping, NULL for an inline batch
+    unsigned char           buf[ P3G_INLINE_MAX ];
+    } p3gatebatch;
+
+// request in flight, the reply is kept in it until the gateway sends it
+typedef struct _p3gatereq {
+    struct _p3gate         *gate;
+    struct _p3gatereq      *next;
+    int                     client;
+    unsigned int            gen;
+    p3gaterec               rec;
+    } p3gatereq;
+
+// one connection, only touched by the gateway thread
+typedef struct _p3gateclient {
+    int                     fd;         // -1 if free
+    unsigned int            gen;        // replies for an earlier connection are dropped
+
+    unsigned char           in[ sizeof(p3gatehdr) + P3G_INLINE_MAX ];
+    int                     inLen;
+    int                     fds[ 8 ];   // memfds that arrived ahead of their header
+    int                     fdCount;
+
+    unsigned char          *batch;      // batch being submitted
+    int                     batchLen;
+    int                     batchPos;
+    int                     batchLeft;  // records still to submit, set while stalled
+    unsigned char          *map;
+
+    unsigned char          *out;        // replies waiting to go
+    int                     outLen;
+    int                     outCount;
+    } p3gateclient;
+
+// daemon side
+typedef struct _p3gate {
+    char                    path[108];
+    int                     listen;
+    int                     efd;        // eventfd, written when replies are waiting
+    int                     epfd;
+    pthread_t               thread;
+
+    struct _p3channel      *link[ 256 ];    // a record can name 256
+    int                     inflight[ 256 ];
+    int                     linkCount;
+
+    p3gateclient            client[ P3G_MAX_CLIENTS ];
+    p3gatereq               req[ P3G_REQUESTS ];
+    p3gatereq              *free;       // gateway thread only
+    int                     stalled;    // clients waiting for a free request
+
+    pthread_mutex_t         lock;       // done and woken, shared with the workers
+    p3gatereq              *done;
+    int                     woken;
+
+    unsigned long           batchesIn;
+    unsigned long           batchesOut;
+    unsigned long           frames;
+    } p3gate;
+
+// records
+int         P3GatePut( unsigned char *buf, p3gaterec *rec );
+int         P3GateGet( unsigned char *buf, int avail, p3gaterec *rec );
+int         P3GateSend( int fd, unsigned char *buf, int length, int count );
+
+// daemon
+int         P3GateInit( p3gate *gate, char *path );
+int         P3GateAdd( p3gate *gate, struct _p3channel *ch );
+int         P3GateStart( p3gate *gate );
+void        P3GateClose( p3gate *gate );
+
+// clients
+int         P3GateConnect( char *path );
+int         P3GateRecv( int fd, p3gatebatch *batch );
+void        P3GateRelease( p3gatebatch *batch );
+
+#endif /* P3GATE_H_ */
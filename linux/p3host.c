@@ -0,0 +1,311 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3host.c                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Communications Demo code for a Linux host                                */
+/*    The host is master to a cortex running the slave demo, or with -s it     */
+/*    pretends to be the cortex so two hosts can talk over a null modem        */
+/*                                                                             */
+/*    usage: p3host [-s] [-d] [-b baud] device                                 */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "p3comms.h"    // p3comms header
+
+/*---------------------------------------------------------------------------*/
+/*  define application specific commands                                     */
+/*---------------------------------------------------------------------------*/
+
+#define CMD2_STATUS_GETMOTORS           0x10
+
+static  p3cmd   Cmd_Motor_Status_Req    = { CMD1_GROUP_STATUS,  CMD2_STATUS_GETMOTORS,           0, {0} };
+static  p3cmd   Cmd_Motor_Status        = { CMD1_GROUP_STATUS_REPLY, CMD2_STATUS_GETMOTORS,     10, {0} };
+
+static  p3cmd   Cmd_Identify            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_IDENTIFY,     0, {0x00} };
+
+// mirrored state layout, same as the cortex demo
+#define MIRROR_MOTORS                   0
+
+// motor values, remote for the master and local for the slave
+static  short   motor[ 10 ];
+
+/*---------------------------------------------------------------------------*/
+/*  Sleep for a number of mS                                                 */
+/*---------------------------------------------------------------------------*/
+
+static void
+hostSleep( int ms )
+{
+    struct timespec ts;
+
+    ts.tv_sec  = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep( &ts, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Fill in motor status, used by the slave for the prebuilt reply           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3UserMotorStatus( p3comms *MyComms, p3cmd *reply )
+{
+    int     i;
+
+    (void)MyComms;
+
+    // shift +- 127 to 0-254 range
+    for(i=0;i<10;i++)
+        reply->data[i] = motor[i] + 0x7F;
+
+    return(1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Example status reply, called by the comms thread when the request ends   */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UserMotorStatusDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3cmdfull   *cmd;
+    int          i;
+
+    (void)MyComms;
+    (void)context;
+
+    // nothing to do for a NAK or timeout
+    if( status != kP3ReqReply )
+        return;
+
+    cmd = &reply->command.cmdpak.cmd;
+
+    // data is in range 0-254, shift to +/- 127
+    if( (cmd->cmd2 == CMD2_STATUS_GETMOTORS) && (cmd->length == 10) )
+        {
+        for(i=0;i<10;i++)
+            motor[i] = cmd->data[i] - 0x7F;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  comms thread, the host has no scheduler tick so sleep for 2mS            */
+/*---------------------------------------------------------------------------*/
+
+static void *
+serialCommsThread( void *arg )
+{
+    p3comms *MyComms = (p3comms *)arg;
+
+    while( 1 )
+        {
+        P3CommsTask( MyComms );
+
+        // P3 comms task expects to be run every 2mS
+        hostSleep(2);
+        }
+
+    return( NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Master setup, before the comms thread starts                             */
+/*---------------------------------------------------------------------------*/
+
+static void
+hostMasterInit( p3comms *MyComms )
+{
+    // probe the slave only when the link goes quiet
+    P3SetLiveness( MyComms, CORTEX_DEVICE_ID, P3_LIVENESS_QUIET );
+    P3ScheduleAdd( MyComms, CORTEX_DEVICE_ID, &Cmd_Motor_Status_Req, 10, 50, P3UserMotorStatusDone, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Master, identify the slave and then display its motors                   */
+/*---------------------------------------------------------------------------*/
+
+static void
+hostMaster( p3comms *MyComms )
+{
+    p3device    *slave = P3GetDevice( MyComms, CORTEX_DEVICE_ID );
+    p3identity  *id    = &slave->identity;
+    int          i;
+
+    while( 1 )
+        {
+        // comms thread probes with backoff while the slave is absent
+        if( slave->online == 0 )
+            {
+            hostSleep(10);
+            continue;
+            }
+
+        if( P3Transact( MyComms, &Cmd_Identify, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT ) != kP3ReqReply )
+            {
+            hostSleep(10);
+            continue;
+            }
+
+        printf("%s %s serial %s firmware %d.%d.%d hardware %d.%d.%d\n",
+                id->manufacturer, id->product_name, id->serial_number,
+                id->firmware_version[0], id->firmware_version[1], id->firmware_version[2],
+                id->hardware_version[0], id->hardware_version[1], id->hardware_version[2] );
+
+        // display until the slave goes away
+        while( slave->online != 0 )
+            {
+            for(i=0;i<10;i++)
+                printf("%4d ", motor[i] );
+            printf("\r");
+            fflush(stdout);
+
+            hostSleep(100);
+            }
+
+        printf("\nslave offline\n");
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave setup, before the comms thread starts                              */
+/*---------------------------------------------------------------------------*/
+
+static void
+hostSlaveInit( p3comms *MyComms )
+{
+    // only answer frames for our address
+    P3SetAddress( MyComms, CORTEX_DEVICE_ID );
+
+    MyComms->deviceType[0] = 0x12;
+    MyComms->deviceType[1] = 0x34;
+
+    P3SetManufacturerString( MyComms, "VEX");
+    P3SetProductNameString( MyComms, "HOST");
+    P3SetSerialNumberString( MyComms, "00001" );
+    P3SetFirmwareVersion( MyComms, 1, 0, 0, 0);
+    P3SetHardwareVersion( MyComms, 1, 0, 0 );
+
+    // motor status reply is kept ready to send
+    P3RegisterPrebuilt( MyComms, CMD1_GROUP_STATUS, CMD2_STATUS_GETMOTORS, &Cmd_Motor_Status, P3UserMotorStatus );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave, answers as a cortex would with a slow sweep on the motors         */
+/*---------------------------------------------------------------------------*/
+
+static void
+hostSlave( p3comms *MyComms )
+{
+    unsigned char   motors[10];
+    int             i;
+    int             count = 0;
+
+    while( 1 )
+        {
+        // let the master know we are still running
+        P3Heartbeat( MyComms );
+
+        motor[0] = (count++ % 255) - 127;
+        for(i=0;i<10;i++)
+            motors[i] = motor[i] + 0x7F;
+        P3MirrorWrite( MyComms, MIRROR_MOTORS, motors, 10 );
+
+        hostSleep(10);
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Open the device and start the comms thread                               */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3comms     *MyComms;
+    pthread_t    thread;
+    p3mode       mode  = kP3ModeMaster;
+    int          debug = 0;
+    long         baud  = 230400;
+    int          c;
+
+    while( (c = getopt( argc, argv, "sdb:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 's':   mode  = kP3ModeSlave;       break;
+            case 'd':   debug = 1;                  break;
+            case 'b':   baud  = atol( optarg );     break;
+            default:
+                fprintf(stderr, "usage: %s [-s] [-d] [-b baud] device\n", argv[0] );
+                return(1);
+            }
+        }
+
+    if( optind >= argc )
+        {
+        fprintf(stderr, "usage: %s [-s] [-d] [-b baud] device\n", argv[0] );
+        return(1);
+        }
+
+    if( (MyComms = P3Open( argv[optind], mode, debug, baud )) == NULL )
+        {
+        perror( argv[optind] );
+        return(1);
+        }
+
+    MyComms->DebugRx = debug;
+    MyComms->DebugTx = debug;
+
+    // link is set up before the comms thread can see it
+    if( mode == kP3ModeMaster )
+        hostMasterInit( MyComms );
+    else
+        hostSlaveInit( MyComms );
+
+    if( pthread_create( &thread, NULL, serialCommsThread, MyComms ) != 0 )
+        {
+        P3Deinit( MyComms );
+        return(1);
+        }
+
+    if( mode == kP3ModeMaster )
+        hostMaster( MyComms );
+    else
+        hostSlave( MyComms );
+
+    return(0);
+}
@@ -0,0 +1,933 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3loop.c                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Event loop for running many p3comms channels from one thread on a        */
+/*    Linux host.  A channel runs only when it has data or a timer is due.     */
+/*                                                                             */
+/*    Two I/O engines.  epoll leaves the reads and writes to the p3comms       */
+/*    glue, one call each per frame.  io_uring keeps a multishot read armed    */
+/*    on every fd into a ring of shared buffers and queues frames to be        */
+/*    written, each pass submits all the writes with a single system call.     */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3loop.h"
+
+// submission queue size for the io_uring engine
+#ifndef P3L_URING_ENTRIES
+#define P3L_URING_ENTRIES   256
+#endif
+
+// buffer group for the shared receive buffers
+#define P3L_BGID            0
+
+// IORING_OP_READ_MULTISHOT, kernel 6.7, not in older headers
+#define P3L_READ_MULTISHOT  49
+
+// what a completion is for, channel index is above this
+#define P3L_OP_RX           1
+#define P3L_OP_TX           2
+#define P3L_OP_WAKE         3
+#define P3L_OP_BELL         4
+#define P3L_OP_SHIFT        8
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring state, there is no liburing so the rings are mapped here        */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3uring {
+    int                     fd;
+
+    // submission queue
+    unsigned               *sqHead;
+    unsigned               *sqTail;
+    unsigned                sqMask;
+    unsigned                sqEntries;
+    struct io_uring_sqe    *sqes;
+    unsigned                sqPending;  // queued but not yet submitted
+
+    // completion queue
+    unsigned               *cqHead;
+    unsigned               *cqTail;
+    unsigned                cqMask;
+    struct io_uring_cqe    *cqes;
+
+    // shared receive buffers
+    struct io_uring_buf_ring *br;
+    unsigned short          brTail;
+    unsigned char          *buffers;
+
+    int                     multishot;  // 0 on kernels without multishot read
+
+    // mappings, kept so a failed setup can undo them
+    unsigned char          *sqRing;
+    unsigned char          *cqRing;
+    size_t                  sqSize;
+    size_t                  cqSize;
+    size_t                  sqesSize;
+    } p3uring;
+
+/*---------------------------------------------------------------------------*/
+/*  Monotonic time in uS                                                     */
+/*---------------------------------------------------------------------------*/
+
+long long
+P3LoopMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - undo a part or fully set up ring                              */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UringFree( p3uring *ur )
+{
+    if( ur->br != NULL && ur->br != MAP_FAILED )
+        munmap( ur->br, P3L_BUFFERS * sizeof(struct io_uring_buf) );
+    free( ur->buffers );
+
+    if( ur->sqes != NULL && ur->sqes != MAP_FAILED )
+        munmap( ur->sqes, ur->sqesSize );
+    if( ur->cqRing != NULL && ur->cqRing != MAP_FAILED && ur->cqRing != ur->sqRing )
+        munmap( ur->cqRing, ur->cqSize );
+    if( ur->sqRing != NULL && ur->sqRing != MAP_FAILED )
+        munmap( ur->sqRing, ur->sqSize );
+
+    if( ur->fd >= 0 )
+        close( ur->fd );
+
+    free( ur );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - map the rings and register the receive buffers                */
+/*---------------------------------------------------------------------------*/
+
+static p3uring *
+P3UringInit( void )
+{
+    struct io_uring_params      p;
+    struct io_uring_buf_reg     reg;
+    p3uring     *ur;
+    unsigned char *sq;
+    unsigned char *cq;
+    unsigned    *array;
+    unsigned     i;
+
+    if( (ur = (p3uring *)calloc( 1, sizeof(p3uring) )) == NULL )
+        return( NULL );
+
+    // multishot reads can complete many times for each submission
+    memset( &p, 0, sizeof(p) );
+    p.flags      = IORING_SETUP_CQSIZE;
+    p.cq_entries = P3L_URING_ENTRIES * 8;
+
+    if( (ur->fd = syscall( __NR_io_uring_setup, P3L_URING_ENTRIES, &p )) < 0 )
+        {
+        free( ur );
+        return( NULL );
+        }
+
+    ur->sqSize   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ur->cqSize   = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    ur->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    if( p.features & IORING_FEAT_SINGLE_MMAP )
+        {
+        if( ur->cqSize > ur->sqSize )
+            ur->sqSize = ur->cqSize;
+        ur->cqSize = ur->sqSize;
+        }
+
+    sq = mmap( NULL, ur->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING );
+    if( p.features & IORING_FEAT_SINGLE_MMAP )
+        cq = sq;
+    else
+        cq = mmap( NULL, ur->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING );
+    ur->sqes = mmap( NULL, ur->sqesSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES );
+    ur->sqRing = sq;
+    ur->cqRing = cq;
+
+    if( sq == MAP_FAILED || cq == MAP_FAILED || ur->sqes == MAP_FAILED )
+        {
+        P3UringFree( ur );
+        return( NULL );
+        }
+
+    ur->sqHead    = (unsigned *)(sq + p.sq_off.head);
+    ur->sqTail    = (unsigned *)(sq + p.sq_off.tail);
+    ur->sqMask    = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ur->sqEntries = p.sq_entries;
+    ur->cqHead    = (unsigned *)(cq + p.cq_off.head);
+    ur->cqTail    = (unsigned *)(cq + p.cq_off.tail);
+    ur->cqMask    = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ur->cqes      = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // sqe index and ring position are always the same
+    array = (unsigned *)(sq + p.sq_off.array);
+    for(i=0;i<p.sq_entries;i++)
+        array[i] = i;
+
+    // shared receive buffers, the kernel picks one for each read
+    ur->br      = mmap( NULL, P3L_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    ur->buffers = malloc( P3L_BUFFERS * P3L_BUFFER_SIZE );
+    if( ur->br == MAP_FAILED || ur->buffers == NULL )
+        {
+        P3UringFree( ur );
+        return( NULL );
+        }
+
+    memset( &reg, 0, sizeof(reg) );
+    reg.ring_addr    = (unsigned long)ur->br;
+    reg.ring_entries = P3L_BUFFERS;
+    reg.bgid         = P3L_BGID;
+    if( syscall( __NR_io_uring_register, ur->fd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+        {
+        P3UringFree( ur );
+        return( NULL );
+        }
+
+    for(i=0;i<P3L_BUFFERS;i++)
+        {
+        ur->br->bufs[i].addr = (unsigned long)(ur->buffers + i * P3L_BUFFER_SIZE);
+        ur->br->bufs[i].len  = P3L_BUFFER_SIZE;
+        ur->br->bufs[i].bid  = i;
+        }
+    ur->brTail = P3L_BUFFERS;
+    __atomic_store_n( &ur->br->tail, ur->brTail, __ATOMIC_RELEASE );
+
+    ur->multishot = 1;
+
+    return( ur );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - submit everything queued and wait for a completion            */
+/*  timeout in mS, -1 waits forever and 0 does not wait                      */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UringEnter( p3uring *ur, int timeout )
+{
+    struct io_uring_getevents_arg   arg;
+    struct __kernel_timespec        ts;
+    unsigned    flags = 0;
+    int         wait  = 0;
+    int         ret;
+
+    memset( &arg, 0, sizeof(arg) );
+    arg.sigmask_sz = _NSIG / 8;
+
+    if( timeout != 0 )
+        {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        wait   = 1;
+        if( timeout > 0 )
+            {
+            ts.tv_sec  = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000L;
+            arg.ts     = (unsigned long)&ts;
+            }
+        }
+    else
+    if( ur->sqPending == 0 )
+        return( 0 );
+
+    ret = syscall( __NR_io_uring_enter, ur->fd, ur->sqPending, wait, flags,
+                   (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL, sizeof(arg) );
+    if( ret >= (int)ur->sqPending )
+        ur->sqPending = 0;
+    else
+    if( ret > 0 )
+        ur->sqPending -= ret;
+
+    return( ret );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - next free submission entry, submits first if the ring is full */
+/*---------------------------------------------------------------------------*/
+
+static struct io_uring_sqe *
+P3UringGetSqe( p3uring *ur )
+{
+    struct io_uring_sqe *sqe;
+    unsigned    tail = *ur->sqTail;
+
+    if( tail - __atomic_load_n( ur->sqHead, __ATOMIC_ACQUIRE ) >= ur->sqEntries )
+        P3UringEnter( ur, 0 );
+
+    sqe = &ur->sqes[ tail & ur->sqMask ];
+    memset( sqe, 0, sizeof(*sqe) );
+
+    return( sqe );
+}
+
+static void
+P3UringPutSqe( p3uring *ur )
+{
+    __atomic_store_n( ur->sqTail, *ur->sqTail + 1, __ATOMIC_RELEASE );
+    ur->sqPending++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - give a receive buffer back to the kernel                      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UringRecycle( p3uring *ur, int bid )
+{
+    struct io_uring_buf *buf = &ur->br->bufs[ ur->brTail & (P3L_BUFFERS-1) ];
+
+    buf->addr = (unsigned long)(ur->buffers + bid * P3L_BUFFER_SIZE);
+    buf->len  = P3L_BUFFER_SIZE;
+    buf->bid  = bid;
+
+    ur->brTail++;
+    __atomic_store_n( &ur->br->tail, ur->brTail, __ATOMIC_RELEASE );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - arm a multishot read, it stays armed until an error.  Older   */
+/*  kernels get a single read that is armed again each pass                  */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UringArmRead( p3uring *ur, p3channel *ch )
+{
+    struct io_uring_sqe *sqe = P3UringGetSqe( ur );
+
+    sqe->opcode     = ur->multishot ? P3L_READ_MULTISHOT : IORING_OP_READ;
+    sqe->fd         = ch->MyComms->fd;
+    sqe->flags      = IOSQE_BUFFER_SELECT;
+    sqe->buf_group  = P3L_BGID;
+    sqe->user_data  = ((unsigned long)ch->index << P3L_OP_SHIFT) | P3L_OP_RX;
+    P3UringPutSqe( ur );
+
+    ch->rxArmed = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - arm a multishot poll for a wake up fd                         */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UringArmPoll( p3uring *ur, int fd, unsigned long user_data )
+{
+    struct io_uring_sqe *sqe = P3UringGetSqe( ur );
+
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->len           = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = user_data;
+    P3UringPutSqe( ur );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring - write what is left of the buffer in flight                    */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UringWrite( p3uring *ur, p3channel *ch )
+{
+    struct io_uring_sqe *sqe = P3UringGetSqe( ur );
+
+    sqe->opcode     = IORING_OP_WRITE;
+    sqe->fd         = ch->MyComms->fd;
+    sqe->addr       = (unsigned long)&ch->tx[ ch->txBuf ^ 1 ][ ch->txSent ];
+    sqe->len        = ch->txLen - ch->txSent;
+    sqe->off        = (unsigned long)-1;
+    sqe->user_data  = ((unsigned long)ch->index << P3L_OP_SHIFT) | P3L_OP_TX;
+    P3UringPutSqe( ur );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring glue - read_buf callback, copies out of the shared buffers      */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UringReadBuf( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    p3channel   *ch = (p3channel *)MyComms->sdp;
+    p3uring     *ur = ch->loop->uring;
+    p3rxbuf     *rx;
+    int          count = 0;
+    int          n;
+
+    while( ch->rxCount > 0 && count < data_len )
+        {
+        rx = &ch->rx[ ch->rxHead ];
+
+        n = rx->len - rx->off;
+        if( n > data_len - count )
+            n = data_len - count;
+
+        memcpy( data + count, ur->buffers + rx->bid * P3L_BUFFER_SIZE + rx->off, n );
+        count   += n;
+        rx->off += n;
+
+        // all used, back to the kernel
+        if( rx->off == rx->len )
+            {
+            P3UringRecycle( ur, rx->bid );
+            ch->rxHead = (ch->rxHead + 1) % P3L_RX_FIFO;
+            ch->rxCount--;
+            }
+        }
+
+    return( count );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring glue - write_buf callback, the frame goes with the next batch   */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UringWriteBuf( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    p3channel   *ch = (p3channel *)MyComms->sdp;
+
+    // far more than the link could send between passes, counted here as
+    // the library does not look, its request times out as if lost
+    if( ch->txFill + data_len > P3L_TX_BUF )
+        {
+        ch->txOverrun++;
+        ch->loop->dropped++;
+        return( -1 );
+        }
+
+    memcpy( &ch->tx[ ch->txBuf ][ ch->txFill ], data, data_len );
+    ch->txFill += data_len;
+
+    return( 0 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run a channel for the ticks elapsed and work out when it is next due     */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3LoopService( p3channel *ch, long long now )
+{
+    long        elapsed;
+    int         next;
+
+    ch->ready = 0;
+
+    // whole ticks only, the remainder carries to the next run
+    elapsed  = (long)((now - ch->last) / P3_TICK_US);
+    ch->last += (long long)elapsed * P3_TICK_US;
+
+    P3CommsRun( ch->MyComms, elapsed );
+    ch->loop->runs++;
+
+    // a run reads P3_RX_BUF_SIZE at most, run again for what is left
+    ch->ready = (ch->rxCount > 0);
+
+    if( ch->service != NULL )
+        ch->service( ch );
+
+    if( (next = P3CommsNext( ch->MyComms )) < 0 )
+        ch->due = -1;
+    else
+        ch->due = ch->last + (long long)next * P3_TICK_US;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Link has gone, adapter unplugged or the other end closed.  Everything    */
+/*  waiting on it finishes as closed, the p3comms is not freed as other      */
+/*  threads may still be submitting to it                                    */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3LoopClose( p3loop *loop, p3channel *ch )
+{
+    if( ch->closed )
+        return;
+
+    if( loop->engine == kP3EngineEpoll )
+        epoll_ctl( loop->epfd, EPOLL_CTL_DEL, ch->MyComms->fd, NULL );
+    else
+        {
+        // buffers not yet read go back to the kernel
+        while( ch->rxCount > 0 )
+            {
+            P3UringRecycle( loop->uring, ch->rx[ ch->rxHead ].bid );
+            ch->rxHead = (ch->rxHead + 1) % P3L_RX_FIFO;
+            ch->rxCount--;
+            }
+        }
+
+    ch->closed = 1;
+    ch->ready  = 0;
+    P3Close( ch->MyComms );
+
+    if( ch->service != NULL )
+        ch->service( ch );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Set up a loop owned by the caller, a thread started to run it must set   */
+/*  loop->thread before other threads submit to its channels                 */
+/*---------------------------------------------------------------------------*/
+
+int
+P3LoopInit( p3loop *loop, p3engine engine )
+{
+    struct epoll_event      ev;
+
+    memset( loop, 0, sizeof(p3loop) );
+    loop->engine = engine;
+    loop->epfd   = -1;
+    loop->thread = pthread_self();
+
+    if( (loop->efd = eventfd( 0, EFD_NONBLOCK )) < 0 )
+        return( P3_FAILURE );
+
+    if( engine == kP3EngineUring )
+        {
+        if( (loop->uring = P3UringInit()) == NULL )
+            return( P3_FAILURE );
+
+        // wake ups arrive as a multishot poll
+        P3UringArmPoll( loop->uring, loop->efd, P3L_OP_WAKE );
+        }
+    else
+        {
+        if( (loop->epfd = epoll_create1( 0 )) < 0 )
+            return( P3_FAILURE );
+
+        ev.events   = EPOLLIN;
+        ev.data.u64 = P3L_OP_WAKE;
+        epoll_ctl( loop->epfd, EPOLL_CTL_ADD, loop->efd, &ev );
+        }
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Add an open channel to the loop, set service and context first           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3LoopAdd( p3loop *loop, p3channel *ch, p3comms *MyComms )
+{
+    struct epoll_event  ev;
+
+    if( loop->channelCount >= P3L_MAX_CHANNELS )
+        return( P3_FAILURE );
+
+    ch->MyComms = MyComms;
+    ch->loop    = loop;
+    ch->index   = loop->channelCount;
+    ch->ready   = 0;
+    ch->closed  = 0;
+    ch->last    = P3LoopMicros();
+    ch->due     = ch->last;
+
+    if( loop->engine == kP3EngineUring )
+        {
+        // io_uring waits on a blocking fd, a non blocking one just fails
+        fcntl( MyComms->fd, F_SETFL, fcntl( MyComms->fd, F_GETFL ) & ~O_NONBLOCK );
+
+        ch->rxHead  = 0;
+        ch->rxCount = 0;
+        ch->txFill  = 0;
+        ch->txBuf   = 0;
+        ch->txLen   = 0;
+        ch->txSent  = 0;
+
+        // the channel is the driver
+        MyComms->sdp        = ch;
+        MyComms->read_buf   = P3UringReadBuf;
+        MyComms->write_buf  = P3UringWriteBuf;
+
+        P3UringArmRead( loop->uring, ch );
+        }
+    else
+        {
+        ev.events   = EPOLLIN;
+        ev.data.u64 = ((unsigned long)ch->index << P3L_OP_SHIFT) | P3L_OP_RX;
+        if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, MyComms->fd, &ev ) < 0 )
+            return( P3_FAILURE );
+        }
+
+    // requests from other threads wake this loop
+    P3SetWake( MyComms, P3LoopWake, loop );
+
+    loop->channel[ loop->channelCount++ ] = ch;
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Another thread submitted work, wake the loop that owns the channel       */
+/*---------------------------------------------------------------------------*/
+
+void
+P3LoopWake( p3comms *MyComms, void *context )
+{
+    p3loop      *loop = (p3loop *)context;
+    uint64_t     one = 1;
+
+    (void)MyComms;
+
+    // the loop itself looks before it sleeps again
+    if( pthread_equal( pthread_self(), loop->thread ) )
+        return;
+
+    if( write( loop->efd, &one, sizeof(one) ) < 0 )
+        return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Add a non blocking fd that runs a channel when readable, such as a fifo  */
+/*  written by another process.  Whatever is written is thrown away.  ch     */
+/*  NULL runs every channel                                                  */
+/*---------------------------------------------------------------------------*/
+
+int
+P3LoopAddBell( p3loop *loop, int fd, p3channel *ch )
+{
+    struct epoll_event  ev;
+    int                 i;
+
+    if( loop->bellCount >= P3L_MAX_BELLS )
+        return( P3_FAILURE );
+
+    i = loop->bellCount++;
+    loop->bell[i]        = fd;
+    loop->bellChannel[i] = ch;
+
+    if( loop->engine == kP3EngineUring )
+        P3UringArmPoll( loop->uring, fd, ((unsigned long)i << P3L_OP_SHIFT) | P3L_OP_BELL );
+    else
+        {
+        ev.events   = EPOLLIN;
+        ev.data.u64 = ((unsigned long)i << P3L_OP_SHIFT) | P3L_OP_BELL;
+        if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+            return( P3_FAILURE );
+        }
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  mS until the earliest timer, -1 if every channel is idle                 */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3LoopTimeout( p3loop *loop )
+{
+    p3channel   *ch;
+    long long    now = P3LoopMicros();
+    long long    wait;
+    int          timeout = -1;
+    int          i;
+
+    for(i=0;i<loop->channelCount;i++)
+        {
+        ch = loop->channel[i];
+        if( ch->closed )
+            continue;
+
+        // data still waiting, run again straight away
+        if( ch->ready )
+            return( 0 );
+        if( ch->due < 0 )
+            continue;
+
+        wait = (ch->due - now + 999) / 1000;
+        if( wait < 0 )
+            wait = 0;
+        if( timeout < 0 || wait < timeout )
+            timeout = (int)wait;
+        }
+
+    return( timeout );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Wake up, the channel or every channel looks at its submit queue          */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3LoopWoken( p3loop *loop, int fd, p3channel *ch )
+{
+    unsigned char   buf[64];
+    int             i;
+
+    // eventfd count or bytes from a bell
+    if( read( fd, buf, sizeof(buf) ) < 0 )
+        return;
+
+    if( ch != NULL )
+        {
+        ch->ready = 1;
+        return;
+        }
+
+    for(i=0;i<loop->channelCount;i++)
+        loop->channel[i]->ready = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  epoll engine - wait for data and mark the channels that have some        */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3LoopWaitEpoll( p3loop *loop, int timeout )
+{
+    struct epoll_event  events[ 64 ];
+    p3channel   *ch;
+    int          op;
+    int          n;
+    int          i;
+
+    loop->waits++;
+    if( (n = epoll_wait( loop->epfd, events, 64, timeout )) < 0 )
+        return;
+
+    for(i=0;i<n;i++)
+        {
+        op = events[i].data.u64 & ((1 << P3L_OP_SHIFT) - 1);
+        if( op == P3L_OP_WAKE )
+            {
+            P3LoopWoken( loop, loop->efd, NULL );
+            continue;
+            }
+        if( op == P3L_OP_BELL )
+            {
+            n = events[i].data.u64 >> P3L_OP_SHIFT;
+            P3LoopWoken( loop, loop->bell[n], loop->bellChannel[n] );
+            continue;
+            }
+
+        ch = loop->channel[ events[i].data.u64 >> P3L_OP_SHIFT ];
+
+        // adapter unplugged
+        if( events[i].events & (EPOLLERR | EPOLLHUP) )
+            {
+            P3LoopClose( loop, ch );
+            continue;
+            }
+
+        ch->ready = 1;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  io_uring engine - send the batch, wait and sort out the completions      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3LoopWaitUring( p3loop *loop, int timeout )
+{
+    p3uring     *ur = loop->uring;
+    struct io_uring_cqe *cqe;
+    p3channel   *ch;
+    p3rxbuf     *rx;
+    unsigned     head;
+    int          op;
+    int          fd;
+    int          i;
+
+    // queue writes and rearm reads, one system call submits them all
+    for(i=0;i<loop->channelCount;i++)
+        {
+        ch = loop->channel[i];
+        if( ch->closed )
+            continue;
+
+        if( ch->txLen == 0 && ch->txFill > 0 )
+            {
+            ch->txLen  = ch->txFill;
+            ch->txSent = 0;
+            ch->txFill = 0;
+            ch->txBuf ^= 1;
+            P3UringWrite( ur, ch );
+            }
+
+        if( !ch->rxArmed )
+            P3UringArmRead( ur, ch );
+        }
+
+    loop->waits++;
+    P3UringEnter( ur, timeout );
+
+    head = *ur->cqHead;
+    while( head != __atomic_load_n( ur->cqTail, __ATOMIC_ACQUIRE ) )
+        {
+        cqe = &ur->cqes[ head & ur->cqMask ];
+        op  = cqe->user_data & ((1 << P3L_OP_SHIFT) - 1);
+
+        if( op == P3L_OP_WAKE || op == P3L_OP_BELL )
+            {
+            if( op == P3L_OP_WAKE )
+                {
+                fd = loop->efd;
+                P3LoopWoken( loop, fd, NULL );
+                }
+            else
+                {
+                fd = loop->bell[ cqe->user_data >> P3L_OP_SHIFT ];
+                P3LoopWoken( loop, fd, loop->bellChannel[ cqe->user_data >> P3L_OP_SHIFT ] );
+                }
+
+            // poll was dropped, add it again
+            if( !(cqe->flags & IORING_CQE_F_MORE) )
+                P3UringArmPoll( ur, fd, cqe->user_data );
+            }
+        else
+        if( (ch = loop->channel[ cqe->user_data >> P3L_OP_SHIFT ])->closed )
+            {
+            // late completion for a closed link
+            if( cqe->flags & IORING_CQE_F_BUFFER )
+                P3UringRecycle( ur, cqe->flags >> IORING_CQE_BUFFER_SHIFT );
+            }
+        else
+        if( op == P3L_OP_RX )
+            {
+            if( !(cqe->flags & IORING_CQE_F_MORE) )
+                ch->rxArmed = 0;
+
+            if( cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER) )
+                {
+                // no room, let the channel take what it has first
+                if( ch->rxCount == P3L_RX_FIFO )
+                    P3LoopService( ch, P3LoopMicros() );
+
+                rx = &ch->rx[ (ch->rxHead + ch->rxCount) % P3L_RX_FIFO ];
+                rx->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                rx->len = cqe->res;
+                rx->off = 0;
+                ch->rxCount++;
+                ch->ready = 1;
+                }
+            else
+            if( cqe->res == -EINVAL && ur->multishot )
+                {
+                // no multishot read, use single reads from now on
+                ur->multishot = 0;
+                }
+            else
+            if( cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EAGAIN) )
+                {
+                // end of file or a real error, -ENOBUFS rearms next pass
+                if( cqe->flags & IORING_CQE_F_BUFFER )
+                    P3UringRecycle( ur, cqe->flags >> IORING_CQE_BUFFER_SHIFT );
+                P3LoopClose( loop, ch );
+                }
+            }
+        else
+        if( op == P3L_OP_TX )
+            {
+            if( cqe->res > 0 )
+                ch->txSent += cqe->res;
+            else
+            if( cqe->res != -EAGAIN && cqe->res != -EINTR )
+                ch->txSent = ch->txLen;
+
+            // short write, send the rest before anything else
+            if( ch->txSent < ch->txLen )
+                P3UringWrite( ur, ch );
+            else
+                ch->txLen = 0;
+            }
+
+        head++;
+        __atomic_store_n( ur->cqHead, head, __ATOMIC_RELEASE );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  One pass, wait for data or the earliest timer then run the channels      */
+/*  that need it                                                             */
+/*---------------------------------------------------------------------------*/
+
+void
+P3LoopOnce( p3loop *loop )
+{
+    p3channel   *ch;
+    long long    now;
+    int          timeout;
+    int          i;
+
+    timeout = P3LoopTimeout( loop );
+
+    if( loop->engine == kP3EngineUring )
+        P3LoopWaitUring( loop, timeout );
+    else
+        P3LoopWaitEpoll( loop, timeout );
+
+    // run the channels with data or a timer due
+    now = P3LoopMicros();
+    for(i=0;i<loop->channelCount;i++)
+        {
+        ch = loop->channel[i];
+
+        // closed, a bell still lets the service answer what was asked
+        if( ch->closed )
+            {
+            if( ch->ready && ch->service != NULL )
+                ch->service( ch );
+            ch->ready = 0;
+            continue;
+            }
+
+        if( ch->ready || (ch->due >= 0 && ch->due <= now) )
+            P3LoopService( ch, now );
+        }
+}
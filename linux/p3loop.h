@@ -0,0 +1,140 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3loop.h                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Header for p3loop.c                                                      */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#ifndef P3LOOP_H_
+#define P3LOOP_H_
+
+#include <pthread.h>
+
+// channels run by one loop
+#ifndef P3L_MAX_CHANNELS
+#define P3L_MAX_CHANNELS    256
+#endif
+
+// fds from other processes that wake the loop, see P3LoopAddBell
+#ifndef P3L_MAX_BELLS
+#define P3L_MAX_BELLS       P3L_MAX_CHANNELS
+#endif
+
+// io_uring engine, received data waiting for each channel
+#ifndef P3L_RX_FIFO
+#define P3L_RX_FIFO         32
+#endif
+// io_uring engine, frames waiting to be written for each channel
+#ifndef P3L_TX_BUF
+#define P3L_TX_BUF          4096
+#endif
+// io_uring engine, receive buffers shared by all channels, power of 2
+#ifndef P3L_BUFFERS
+#define P3L_BUFFERS         1024
+#endif
+#ifndef P3L_BUFFER_SIZE
+#define P3L_BUFFER_SIZE     256
+#endif
+
+// I/O engines
+typedef enum {
+    kP3EngineEpoll = 0,     // epoll, a read and a write call per frame
+    kP3EngineUring          // io_uring, multishot reads and batched writes
+    } p3engine;
+
+// received data waiting in a shared buffer, io_uring engine
+typedef struct _p3rxbuf {
+    unsigned short  bid;
+    unsigned short  len;
+    unsigned short  off;
+    } p3rxbuf;
+
+/*---------------------------------------------------------------------------*/
+/*  One link, only touched by the thread running its loop                    */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3channel {
+    p3comms        *MyComms;    // kept after close as other threads may hold it
+    struct _p3loop *loop;
+    int             index;
+    int             ready;      // data arrived this pass
+    volatile int    closed;     // link has gone, see P3Close
+
+    long long       last;       // time of the last tick run, uS
+    long long       due;        // when a timer is next due, -1 for none
+
+    // called after each run, once closed only when a bell rings for it
+    void           (*service)( struct _p3channel *ch );
+    void            *context;
+
+    // io_uring engine only
+    p3rxbuf         rx[P3L_RX_FIFO];
+    int             rxHead;
+    int             rxCount;
+    int             rxArmed;    // multishot read outstanding
+    unsigned char   tx[2][P3L_TX_BUF];
+    int             txFill;     // bytes waiting in tx[txBuf]
+    int             txBuf;      // buffer being filled
+    int             txLen;      // bytes of the other buffer being written, 0 for none
+    int             txSent;     // and how many have gone
+    unsigned long   txOverrun;  // frames dropped with the buffer full
+    } p3channel;
+
+/*---------------------------------------------------------------------------*/
+/*  One event loop                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3loop {
+    p3engine        engine;
+    int             epfd;
+    int             efd;        // eventfd, written when work is submitted
+    struct _p3uring *uring;
+    pthread_t       thread;     // thread running the loop, see P3LoopWake
+    int             bell[ P3L_MAX_BELLS ];
+    p3channel      *bellChannel[ P3L_MAX_BELLS ];
+    int             bellCount;
+
+    p3channel      *channel[ P3L_MAX_CHANNELS ];
+    int             channelCount;
+
+    unsigned long   runs;       // engine runs
+    unsigned long   waits;      // calls into the kernel to wait
+    unsigned long   dropped;    // frames not sent with a tx buffer full
+    } p3loop;
+
+long long   P3LoopMicros( void );
+int         P3LoopInit( p3loop *loop, p3engine engine );
+int         P3LoopAdd( p3loop *loop, p3channel *ch, p3comms *MyComms );
+void        P3LoopOnce( p3loop *loop );
+void        P3LoopWake( p3comms *MyComms, void *context );
+int         P3LoopAddBell( p3loop *loop, int fd, p3channel *ch );
+
+#endif /* P3LOOP_H_ */
@@ -0,0 +1,407 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3micro.c                                                    */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Micro benchmarks for the protocol hot paths, no I/O.  Each case runs     */
+/*    for about the given time a few times and keeps the fastest, reported     */
+/*    as nS per frame and frame bytes per second.                              */
+/*                                                                             */
+/*    checksum  XOR over an encoded frame, the loop P3EncodeFrame and the      */
+/*              receiver run byte by byte, on its own                          */
+/*    encode    P3EncodeFrame, header, data copy and checksum                  */
+/*    command   P3Command, encode and hand to write_buf                        */
+/*    receive   P3ReceivePacket, framing and checksum, a decoder takes it      */
+/*    dispatch  P3DecodePacket, a system request answered by the library       */
+/*                                                                             */
+/*    usage: p3micro [-b base] [-w base] [-t percent] [-m mS]                  */
+/*    -b compares with a saved run and fails if any case is more than          */
+/*       percent slower, -w saves this run                                     */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "p3comms.h"    // p3comms header
+
+// runs of each case, the fastest is kept
+#define P3M_RUNS        5
+
+#define P3M_MAX_CASES   16
+
+typedef struct _p3mcase {
+    char           *name;
+    int             frames;     // frames each call
+    int             bytes;      // frame bytes each call
+    void           (*run)( long n );
+    double          ns;         // per frame
+    } p3mcase;
+
+static  p3comms        *master;
+static  p3comms        *slave;
+static  p3cmd           small;
+static  p3cmdfull       full;
+static  unsigned char   frame[ P3_FULL_MSG + 6 ];
+static  unsigned char   checked[ P3_FULL_MSG + 6 ];
+static  unsigned char   stream[ P3_RX_BUF_SIZE ];
+static  int             streamLen;
+static  p3pak           request;
+
+// stop the compiler dropping the work
+static  volatile unsigned long  sink;
+
+/*---------------------------------------------------------------------------*/
+/*  Link ends that go nowhere                                                */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3MicroWrite( p3comms *MyComms, unsigned char *buffer, int len )
+{
+    (void)MyComms;
+
+    sink += buffer[ len - 1 ];
+    return( len );
+}
+
+static int
+P3MicroDecode( p3comms *MyComms, p3pak *packet )
+{
+    (void)MyComms;
+
+    sink += packet->command.cmdpak.cmd.length;
+    return(1);
+}
+
+static p3comms *
+P3MicroOpen( p3mode mode )
+{
+    p3comms *MyComms;
+
+    if( (MyComms = P3Init( -1, mode, 0, 115200 )) == NULL )
+        exit(1);
+
+    MyComms->init       = NULL;
+    MyComms->deinit     = NULL;
+    MyComms->flush      = NULL;
+    MyComms->write_buf  = P3MicroWrite;
+    MyComms->read_buf   = NULL;
+
+    return( MyComms );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  The cases                                                                */
+/*---------------------------------------------------------------------------*/
+
+// the frame is encoded once, only the XOR is timed, the id byte changes
+// each call so the compiler cannot keep the sum
+static void
+P3MicroChecksum( long n, int len )
+{
+    unsigned char   chk_sum;
+    int             i;
+
+    while( n-- > 0 )
+        {
+        checked[2] = (unsigned char)n;
+        for(i=0,chk_sum=0;i<len;i++)
+            chk_sum ^= checked[i];
+        sink += chk_sum;
+        }
+}
+
+static void
+P3MicroChecksumSmall( long n )
+{
+    P3MicroChecksum( n, P3_SMALL_MSG + 6 );
+}
+
+static void
+P3MicroChecksumFull( long n )
+{
+    P3MicroChecksum( n, P3_FULL_MSG + 6 );
+}
+
+static void
+P3MicroEncodeSmall( long n )
+{
+    while( n-- > 0 )
+        sink += P3EncodeFrame( frame, &small, 1 );
+}
+
+static void
+P3MicroEncodeFull( long n )
+{
+    while( n-- > 0 )
+        sink += P3EncodeFrame( frame, &full, 1 );
+}
+
+// slave, so there is no reply to wait for
+static void
+P3MicroCommandSmall( long n )
+{
+    while( n-- > 0 )
+        P3Command( slave, &small, 1 );
+}
+
+static void
+P3MicroCommandFull( long n )
+{
+    while( n-- > 0 )
+        P3Command( slave, &full, 1 );
+}
+
+// master with no request open, rxbuf is only read
+static void
+P3MicroReceive( long n )
+{
+    while( n-- > 0 )
+        P3ReceivePacket( master );
+}
+
+static void
+P3MicroDispatch( long n )
+{
+    while( n-- > 0 )
+        P3DecodePacket( slave, &request );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Fill the receive buffer with back to back replies                        */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3MicroStream( void *command )
+{
+    int     len;
+    int     frames = 0;
+
+    streamLen = 0;
+    while( (len = P3EncodeFrame( frame, command, 1 )) <= P3_RX_BUF_SIZE - streamLen )
+        {
+        memcpy( &stream[ streamLen ], frame, len );
+        streamLen += len;
+        frames++;
+        }
+
+    memcpy( master->rxbuf, stream, streamLen );
+    master->rxcnt = streamLen;
+
+    return( frames );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Time one case, calls are doubled until a run is long enough              */
+/*---------------------------------------------------------------------------*/
+
+static double
+P3MicroNow( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec * 1e9 + ts.tv_nsec );
+}
+
+static void
+P3MicroTime( p3mcase *c, double ms )
+{
+    long    n = 1;
+    double  t, best = 0;
+    int     i;
+
+    for(;;)
+        {
+        t = P3MicroNow();
+        c->run( n );
+        t = P3MicroNow() - t;
+        if( t >= ms * 1e6 / P3M_RUNS )
+            break;
+        n *= 2;
+        }
+
+    for(i=0;i<P3M_RUNS;i++)
+        {
+        t = P3MicroNow();
+        c->run( n );
+        t = P3MicroNow() - t;
+        if( i == 0 || t < best )
+            best = t;
+        }
+
+    c->ns = best / n / c->frames;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Saved runs, one case a line as name then nS per frame                    */
+/*---------------------------------------------------------------------------*/
+
+static double
+P3MicroBase( FILE *fp, char *name )
+{
+    char    line[128];
+    char    found[64];
+    double  ns;
+
+    rewind( fp );
+    while( fgets( line, sizeof(line), fp ) != NULL )
+        {
+        if( sscanf( line, "%63s %lf", found, &ns ) == 2 && strcmp( found, name ) == 0 )
+            return( ns );
+        }
+
+    return( -1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run every case and report                                                */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3mcase      cases[ P3M_MAX_CASES ];
+    int          ncases = 0;
+    char        *base = NULL;
+    char        *save = NULL;
+    double       percent = 20;
+    double       ms = 250;
+    double       was, change;
+    FILE        *fp = NULL;
+    int          failed = 0;
+    int          i;
+    int          c;
+
+    while( (c = getopt( argc, argv, "b:w:t:m:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'b':   base    = optarg;           break;
+            case 'w':   save    = optarg;           break;
+            case 't':   percent = atof( optarg );   break;
+            case 'm':   ms      = atof( optarg );   break;
+            default:
+                fprintf(stderr, "usage: %s [-b base] [-w base] [-t percent] [-m mS]\n", argv[0] );
+                return(1);
+            }
+        }
+
+    master = P3MicroOpen( kP3ModeMaster );
+    slave  = P3MicroOpen( kP3ModeSlave );
+    P3SetReplyDecoder( master, P3MicroDecode );
+    P3SetAddress( slave, 1 );
+
+    small.cmd1   = CMD1_GROUP_STATUS_REPLY;
+    small.cmd2   = 0x30;
+    small.length = P3_SMALL_MSG;
+    full.cmd1    = CMD1_GROUP_STATUS_REPLY;
+    full.cmd2    = 0x30;
+    full.length  = P3_FULL_MSG;
+    for(i=0;i<P3_FULL_MSG;i++)
+        full.data[i] = (unsigned char)(i * 17);
+    memcpy( small.data, full.data, P3_SMALL_MSG );
+
+    // a full frame to checksum, its own checksum makes the XOR 0
+    P3EncodeFrame( frame, &full, 1 );
+    for(i=0;i<P3_FULL_MSG + 6;i++)
+        checked[i] = frame[i];
+
+    cases[ncases++] = (p3mcase){ "checksum_small", 1, P3_SMALL_MSG + 6, P3MicroChecksumSmall, 0 };
+    cases[ncases++] = (p3mcase){ "checksum_full",  1, P3_FULL_MSG + 6,  P3MicroChecksumFull,  0 };
+    cases[ncases++] = (p3mcase){ "encode_small",   1, P3_SMALL_MSG + 6, P3MicroEncodeSmall,  0 };
+    cases[ncases++] = (p3mcase){ "encode_full",    1, P3_FULL_MSG + 6,  P3MicroEncodeFull,   0 };
+    cases[ncases++] = (p3mcase){ "command_small",  1, P3_SMALL_MSG + 6, P3MicroCommandSmall, 0 };
+    cases[ncases++] = (p3mcase){ "command_full",   1, P3_FULL_MSG + 6,  P3MicroCommandFull,  0 };
+    cases[ncases++] = (p3mcase){ "receive_small",  0, P3_SMALL_MSG + 6, P3MicroReceive,      0 };
+    cases[ncases++] = (p3mcase){ "receive_full",   0, P3_FULL_MSG + 6,  P3MicroReceive,      0 };
+    cases[ncases++] = (p3mcase){ "dispatch",       1, 6,                P3MicroDispatch,     0 };
+
+    // device type request, the slave builds and sends the reply
+    request.cmd_len = P3EncodeFrame( request.command.data, &(p3cmd){ CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE, 0, {0} }, 1 );
+    request.dev_id      = 1;
+    request.masked_cmd1 = CMD1_GROUP_SYSTEM_CMD;
+
+    if( base != NULL && (fp = fopen( base, "r" )) == NULL )
+        {
+        perror( base );
+        return(1);
+        }
+
+    printf("case              nS/frame       MB/s");
+    printf( fp != NULL ? "      base  change\n" : "\n" );
+
+    for(i=0;i<ncases;i++)
+        {
+        if( strncmp( cases[i].name, "receive", 7 ) == 0 )
+            cases[i].frames = P3MicroStream( strcmp( cases[i].name, "receive_full" ) == 0 ? (void *)&full : (void *)&small );
+
+        P3MicroTime( &cases[i], ms );
+
+        printf("%-14s %11.1f %10.1f", cases[i].name, cases[i].ns, cases[i].bytes * 1e3 / cases[i].ns );
+
+        if( fp != NULL && (was = P3MicroBase( fp, cases[i].name )) > 0 )
+            {
+            change = (cases[i].ns - was) * 100.0 / was;
+            printf(" %9.1f %6.1f%%%s", was, change, change > percent ? "  slower" : "" );
+            if( change > percent )
+                failed++;
+            }
+        printf("\n");
+        }
+
+    if( fp != NULL )
+        fclose( fp );
+
+    if( save != NULL )
+        {
+        if( (fp = fopen( save, "w" )) == NULL )
+            {
+            perror( save );
+            return(1);
+            }
+        for(i=0;i<ncases;i++)
+            fprintf( fp, "%s %.2f\n", cases[i].name, cases[i].ns );
+        fclose( fp );
+        }
+
+    P3Deinit( master );
+    P3Deinit( slave );
+
+    if( failed )
+        {
+        printf("%d case%s more than %.0f%% slower than %s\n", failed, failed > 1 ? "s" : "", percent, base );
+        return(1);
+        }
+
+    return(0);
+}
@@ -0,0 +1,583 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3shm.c                                                      */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Shared memory access to a link for other processes on the host           */
+/*                                                                             */
+/*    The daemon owns the serial fd and a segment in /dev/shm for each link.   */
+/*    Clients put commands in one ring, claimed with compare and swap as in    */
+/*    P3Request, and the daemon passes them to P3Request.  Each client has     */
+/*    its own ring of frames that only the daemon writes, replies carry the    */
+/*    id P3ShmSubmit returned and monitor clients also get every frame.        */
+/*    Frames are read in place.                                                */
+/*                                                                             */
+/*    A client rings a fifo to wake the daemon, only when the daemon has       */
+/*    armed it, and the daemon wakes a sleeping client with a futex.           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3shm.h"
+
+#define P3_MEMORY_BARRIER()         __sync_synchronize()
+
+/*---------------------------------------------------------------------------*/
+/*  fifo used as the bell for a segment                                      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ShmBellPath( char *path, int len, char *name )
+{
+    snprintf( path, len, "/dev/shm%s.bell", name );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  futex on a shared word, not private as the waiter is another process     */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3ShmFutex( volatile unsigned int *addr, int op, unsigned int val, struct timespec *ts )
+{
+    return( syscall( SYS_futex, addr, op, val, ts, NULL, 0 ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - put a frame in a client ring, dropped if the client is behind   */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ShmPush( p3shm *shm, int client, unsigned int id, p3reqstatus status, int dev_id, p3cmdfull *cmd )
+{
+    p3shmclient *c = &shm->seg->client[ client ];
+    p3shmframe  *f;
+    unsigned int head = c->head;
+
+    if( c->pid == 0 )
+        return;
+
+    if( head - c->tail >= P3S_FRAME_SLOTS )
+        {
+        c->dropped++;
+        return;
+        }
+
+    // never more than a frame holds, the status still goes
+    if( cmd != NULL && cmd->length > P3_FULL_MSG )
+        cmd = NULL;
+
+    f = &c->frame[ head & (P3S_FRAME_SLOTS-1) ];
+    f->id     = id;
+    f->status = status;
+    f->dev_id = dev_id;
+    f->valid  = (cmd != NULL);
+    if( cmd != NULL )
+        memcpy( &f->cmd, cmd, cmd->length + 3 );
+
+    // frame must be complete before the client can see it
+    P3_MEMORY_BARRIER();
+    c->head = head + 1;
+
+    P3_MEMORY_BARRIER();
+    if( c->waiting )
+        P3ShmFutex( &c->head, FUTEX_WAKE, INT_MAX, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - a client request finished, requests finish in the order they    */
+/*  were submitted                                                           */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ShmDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3shm       *shm = (p3shm *)context;
+    int          i;
+
+    (void)MyComms;
+
+    if( shm->pendCount == 0 )
+        return;
+
+    i = shm->pendHead;
+    shm->pendHead = (shm->pendHead + 1) % P3S_PENDING;
+    shm->pendCount--;
+
+    P3ShmPush( shm, shm->pendClient[i], shm->pendId[i], status,
+               reply ? reply->dev_id : 0, reply ? &reply->command.cmdpak.cmd : NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - monitor callback, every good frame to the monitor clients       */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ShmMonitor( p3comms *MyComms, p3pak *packet, void *context )
+{
+    p3shm       *shm = (p3shm *)context;
+    int          i;
+
+    (void)MyComms;
+
+    for(i=0;i<P3S_MAX_CLIENTS;i++)
+        {
+        if( shm->seg->client[i].pid != 0 && (shm->seg->client[i].flags & P3S_MONITOR) )
+            P3ShmPush( shm, i, 0, kP3ReqReply, packet->dev_id, &packet->command.cmdpak.cmd );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - create the segment and bell for a link, name as for shm_open    */
+/*---------------------------------------------------------------------------*/
+
+p3shm *
+P3ShmCreate( char *name, p3comms *MyComms )
+{
+    p3shm       *shm;
+    char         path[96];
+    int          fd;
+    int          i;
+
+    if( (shm = (p3shm *)calloc( 1, sizeof(p3shm) )) == NULL )
+        return( NULL );
+
+    strncpy( shm->name, name, sizeof(shm->name) - 1 );
+
+    if( (fd = shm_open( name, O_CREAT | O_RDWR, P3S_MODE )) < 0 )
+        {
+        free( shm );
+        return( NULL );
+        }
+
+    if( ftruncate( fd, sizeof(p3shmseg) ) < 0 ||
+        (shm->seg = mmap( NULL, sizeof(p3shmseg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED )
+        {
+        close( fd );
+        shm_unlink( name );
+        free( shm );
+        return( NULL );
+        }
+    close( fd );
+
+    memset( shm->seg, 0, sizeof(p3shmseg) );
+    for(i=0;i<P3S_CMD_SLOTS;i++)
+        shm->seg->cmd[i].seq = i;
+    shm->seg->version   = P3S_VERSION;
+    shm->seg->pid       = getpid();
+    shm->seg->bellArmed = 1;
+
+    // opened for write as well so it never sees end of file
+    P3ShmBellPath( path, sizeof(path), name );
+    unlink( path );
+    if( mkfifo( path, P3S_MODE ) < 0 || (shm->bell = open( path, O_RDWR | O_NONBLOCK )) < 0 )
+        {
+        munmap( shm->seg, sizeof(p3shmseg) );
+        shm_unlink( name );
+        free( shm );
+        return( NULL );
+        }
+
+    // clients check this last
+    P3_MEMORY_BARRIER();
+    shm->seg->magic = P3S_MAGIC;
+
+    P3SetMonitor( MyComms, P3ShmMonitor, shm );
+
+    return( shm );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - pass client commands to the link, call after each run           */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ShmService( p3shm *shm, p3comms *MyComms )
+{
+    p3shmseg    *seg = shm->seg;
+    p3shmcmd    *slot;
+    unsigned int tail;
+    int          i;
+
+    for(;;)
+        {
+        tail = seg->cmdTail;
+        slot = &seg->cmd[ tail & (P3S_CMD_SLOTS-1) ];
+
+        if( slot->seq != tail + 1 )
+            {
+            // nothing left, ask to be rung then look once more in case
+            // a command arrived before the bell was armed
+            seg->bellArmed = 1;
+            P3_MEMORY_BARRIER();
+            if( slot->seq != tail + 1 )
+                return;
+            }
+
+        // leave it in the ring until the link can take it
+        if( shm->pendCount == P3S_PENDING )
+            return;
+
+        P3_MEMORY_BARRIER();
+
+        // any process can write the ring, check what it wrote
+        if( slot->client >= P3S_MAX_CLIENTS )
+            {
+            // no one to answer
+            }
+        else
+        if( slot->cmd.length > P3_SMALL_MSG )
+            {
+            P3ShmPush( shm, slot->client, slot->id, kP3ReqNak, 0, NULL );
+            }
+        else
+        if( MyComms->closed )
+            {
+            // link has gone, answer straight away
+            P3ShmPush( shm, slot->client, slot->id, kP3ReqClosed, 0, NULL );
+            }
+        else
+            {
+            // recorded first as a close can complete it inside P3Request
+            i = (shm->pendHead + shm->pendCount) % P3S_PENDING;
+            shm->pendId[i]     = slot->id;
+            shm->pendClient[i] = slot->client;
+            shm->pendCount++;
+
+            if( P3Request( MyComms, &slot->cmd, slot->dest_id, P3ShmDone, shm ) != P3_SUCCESS )
+                {
+                if( !MyComms->closed )
+                    {
+                    shm->pendCount--;
+                    return;
+                    }
+                }
+            }
+
+        // slot is free for the clients one lap later
+        P3_MEMORY_BARRIER();
+        slot->seq    = tail + P3S_CMD_SLOTS;
+        seg->cmdTail = tail + 1;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Daemon - remove the segment, clients keep their mapping until detach     */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ShmDestroy( p3shm *shm )
+{
+    char         path[96];
+
+    P3ShmBellPath( path, sizeof(path), shm->name );
+    unlink( path );
+    close( shm->bell );
+
+    shm_unlink( shm->name );
+    munmap( shm->seg, sizeof(p3shmseg) );
+    free( shm );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - map a link and take a client slot, slots left by a client that  */
+/*  died are taken back                                                      */
+/*---------------------------------------------------------------------------*/
+
+p3shm *
+P3ShmAttach( char *name, int flags )
+{
+    p3shm       *shm;
+    p3shmclient *c;
+    char         path[96];
+    int          fd;
+    int          pid;
+    int          i;
+
+    if( (shm = (p3shm *)calloc( 1, sizeof(p3shm) )) == NULL )
+        return( NULL );
+
+    strncpy( shm->name, name, sizeof(shm->name) - 1 );
+    shm->client = -1;
+    shm->bell   = -1;
+
+    if( (fd = shm_open( name, O_RDWR, 0 )) < 0 )
+        {
+        free( shm );
+        return( NULL );
+        }
+
+    shm->seg = mmap( NULL, sizeof(p3shmseg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( shm->seg == MAP_FAILED )
+        {
+        free( shm );
+        return( NULL );
+        }
+
+    if( shm->seg->magic != P3S_MAGIC || shm->seg->version != P3S_VERSION )
+        {
+        errno = EPROTO;
+        P3ShmDetach( shm );
+        return( NULL );
+        }
+
+    for(i=0;i<P3S_MAX_CLIENTS && shm->client < 0;i++)
+        {
+        c   = &shm->seg->client[i];
+        pid = c->pid;
+
+        if( pid != 0 && !(kill( pid, 0 ) < 0 && errno == ESRCH) )
+            continue;
+        if( !__sync_bool_compare_and_swap( &c->pid, pid, getpid() ) )
+            continue;
+
+        // anything left belongs to the previous owner
+        c->flags   = flags;
+        c->waiting = 0;
+        c->dropped = 0;
+        c->tail    = c->head;
+        shm->client = i;
+        }
+
+    if( shm->client < 0 )
+        {
+        errno = EBUSY;
+        P3ShmDetach( shm );
+        return( NULL );
+        }
+
+    P3ShmBellPath( path, sizeof(path), name );
+    if( (shm->bell = open( path, O_WRONLY | O_NONBLOCK )) < 0 )
+        {
+        P3ShmDetach( shm );
+        return( NULL );
+        }
+
+    return( shm );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - submit a command, returns the id the reply will carry or        */
+/*  P3_FAILURE if the ring is full                                           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ShmSubmit( p3shm *shm, void *command, int dest_id )
+{
+    p3cmdfull   *MyCmd = (p3cmdfull *)command;
+    p3shmseg    *seg = shm->seg;
+    p3shmcmd    *slot;
+    unsigned int pos;
+    unsigned int id;
+    int          dif;
+
+    if( MyCmd->length > P3_SMALL_MSG )
+        return( P3_FAILURE );
+
+    pos = seg->cmdHead;
+    for(;;)
+        {
+        slot = &seg->cmd[ pos & (P3S_CMD_SLOTS-1) ];
+        dif  = (int)(slot->seq - pos);
+
+        if( dif == 0 )
+            {
+            // free, try and claim it
+            if( __sync_bool_compare_and_swap( &seg->cmdHead, pos, pos + 1 ) )
+                break;
+            }
+        else
+        if( dif < 0 )
+            {
+            // full
+            return( P3_FAILURE );
+            }
+
+        // another client got there first
+        pos = seg->cmdHead;
+        }
+
+    // ids are positive, 0 marks a monitored frame
+    id = __sync_add_and_fetch( &seg->nextId, 1 ) & INT_MAX;
+    if( id == 0 )
+        id = __sync_add_and_fetch( &seg->nextId, 1 ) & INT_MAX;
+
+    memcpy( &slot->cmd, MyCmd, MyCmd->length + 3 );
+    slot->id      = id;
+    slot->client  = shm->client;
+    slot->dest_id = dest_id;
+
+    // command must be complete before the daemon can see it
+    P3_MEMORY_BARRIER();
+    slot->seq = pos + 1;
+
+    // ring only if the daemon asked, it disarms as it takes the bell
+    if( __sync_lock_test_and_set( &seg->bellArmed, 0 ) )
+        {
+        if( write( shm->bell, "", 1 ) < 0 )
+            seg->bellArmed = 1;
+        }
+
+    return( (int)id );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - next frame, read in place, NULL if there is none                */
+/*---------------------------------------------------------------------------*/
+
+p3shmframe *
+P3ShmPeek( p3shm *shm )
+{
+    p3shmclient *c = &shm->seg->client[ shm->client ];
+
+    if( c->tail == c->head )
+        return( NULL );
+
+    P3_MEMORY_BARRIER();
+    return( &c->frame[ c->tail & (P3S_FRAME_SLOTS-1) ] );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - done with the frame from P3ShmPeek                              */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ShmRelease( p3shm *shm )
+{
+    p3shmclient *c = &shm->seg->client[ shm->client ];
+
+    P3_MEMORY_BARRIER();
+    c->tail++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - sleep until a frame arrives, timeout in mS or -1 for ever       */
+/*  returns 1 if there is a frame                                            */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ShmWait( p3shm *shm, int timeout )
+{
+    p3shmclient *c = &shm->seg->client[ shm->client ];
+    struct timespec ts;
+    unsigned int head;
+
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+    c->waiting = 1;
+    P3_MEMORY_BARRIER();
+
+    head = c->head;
+    if( head == c->tail )
+        P3ShmFutex( &c->head, FUTEX_WAIT, head, (timeout < 0) ? NULL : &ts );
+
+    c->waiting = 0;
+
+    return( c->head != c->tail );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - submit and wait for the reply, frames before it are dropped     */
+/*  returns the p3reqstatus, reply may be NULL                               */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ShmTransact( p3shm *shm, void *command, int dest_id, p3cmdfull *reply, int timeout )
+{
+    p3shmframe  *f;
+    struct timespec now;
+    long long    end;
+    long long    t;
+    int          status;
+    int          id;
+
+    if( (id = P3ShmSubmit( shm, command, dest_id )) < 0 )
+        return( P3_FAILURE );
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    end = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + timeout;
+
+    for(;;)
+        {
+        while( (f = P3ShmPeek( shm )) != NULL )
+            {
+            if( f->id == (unsigned int)id )
+                {
+                status = f->status;
+                if( reply != NULL && f->valid )
+                    {
+                    if( f->cmd.length <= P3_FULL_MSG )
+                        memcpy( reply, &f->cmd, f->cmd.length + 3 );
+                    else
+                        status = kP3ReqNak;
+                    }
+                P3ShmRelease( shm );
+                return( status );
+                }
+            P3ShmRelease( shm );
+            }
+
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        if( (t = end - (now.tv_sec * 1000LL + now.tv_nsec / 1000000)) <= 0 )
+            return( kP3ReqTimeout );
+
+        P3ShmWait( shm, (int)t );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Client - give the slot back and unmap                                    */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ShmDetach( p3shm *shm )
+{
+    if( shm->client >= 0 )
+        shm->seg->client[ shm->client ].pid = 0;
+    if( shm->bell >= 0 )
+        close( shm->bell );
+
+    munmap( shm->seg, sizeof(p3shmseg) );
+    free( shm );
+}
@@ -0,0 +1,140 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3shm.h                                                      */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Header for p3shm.c                                                       */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#ifndef P3SHM_H_
+#define P3SHM_H_
+
+// segment layout, bump the version if it changes
+#define P3S_MAGIC           0x50335348
+#define P3S_VERSION         1
+
+// clients attached to one link
+#ifndef P3S_MAX_CLIENTS
+#define P3S_MAX_CLIENTS     8
+#endif
+// commands waiting for the daemon, power of 2
+#ifndef P3S_CMD_SLOTS
+#define P3S_CMD_SLOTS       64
+#endif
+// frames waiting for each client, power of 2
+#ifndef P3S_FRAME_SLOTS
+#define P3S_FRAME_SLOTS     64
+#endif
+// segment and bell, clients in the daemon's group may attach
+#ifndef P3S_MODE
+#define P3S_MODE            0660
+#endif
+
+// client flags
+#define P3S_MONITOR         0x01    // also receive every frame from the link
+
+// command from a client, slots are claimed as for P3Request
+typedef struct _p3shmcmd {
+    volatile unsigned int   seq;
+    unsigned int            id;         // returned with the reply
+    unsigned char           client;
+    unsigned char           dest_id;
+    p3cmd                   cmd;
+    } p3shmcmd;
+
+// frame for a client, read in place
+typedef struct _p3shmframe {
+    unsigned int            id;         // P3ShmSubmit id answered, 0 for a monitored frame
+    short                   status;     // p3reqstatus
+    unsigned char           dev_id;
+    unsigned char           valid;      // cmd holds the reply, not set for a timeout
+    p3cmdfull               cmd;
+    } p3shmframe;
+
+// one client, only the daemon writes frames and only the client reads them
+typedef struct _p3shmclient {
+    volatile int            pid;        // owner, 0 if free
+    unsigned int            flags;
+    volatile unsigned int   head;       // written by the daemon
+    volatile unsigned int   tail;       // written by the client
+    volatile unsigned int   waiting;    // client is asleep on head
+    unsigned int            dropped;    // frames lost with the ring full
+    p3shmframe              frame[ P3S_FRAME_SLOTS ];
+    } p3shmclient;
+
+// the shared segment for one link
+typedef struct _p3shmseg {
+    unsigned int            magic;
+    unsigned int            version;
+    int                     pid;        // daemon
+    volatile unsigned int   bellArmed;  // daemon wants the bell rung for new commands
+    volatile unsigned int   nextId;
+
+    volatile unsigned int   cmdHead;    // next slot to claim, any client
+    unsigned int            cmdTail;    // daemon only
+    p3shmcmd                cmd[ P3S_CMD_SLOTS ];
+
+    p3shmclient             client[ P3S_MAX_CLIENTS ];
+    } p3shmseg;
+
+// pending replies, daemon only, in the order they were submitted
+#define P3S_PENDING         P3_SUBMIT_QUEUE_SIZE
+
+// daemon or client view of a link
+typedef struct _p3shm {
+    p3shmseg               *seg;
+    char                    name[64];
+    int                     bell;       // fifo, clients write and the daemon reads
+
+    // daemon
+    unsigned int            pendId[ P3S_PENDING ];
+    unsigned char           pendClient[ P3S_PENDING ];
+    int                     pendHead;
+    int                     pendCount;
+
+    // client
+    int                     client;
+    } p3shm;
+
+// daemon
+p3shm *     P3ShmCreate( char *name, p3comms *MyComms );
+void        P3ShmService( p3shm *shm, p3comms *MyComms );
+void        P3ShmDestroy( p3shm *shm );
+
+// clients
+p3shm *     P3ShmAttach( char *name, int flags );
+int         P3ShmSubmit( p3shm *shm, void *command, int dest_id );
+p3shmframe *P3ShmPeek( p3shm *shm );
+void        P3ShmRelease( p3shm *shm );
+int         P3ShmWait( p3shm *shm, int timeout );
+int         P3ShmTransact( p3shm *shm, void *command, int dest_id, p3cmdfull *reply, int timeout );
+void        P3ShmDetach( p3shm *shm );
+
+#endif /* P3SHM_H_ */
@@ -0,0 +1,599 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3sim.c                                                      */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Discrete event simulator for the demo master and slave                   */
+/*                                                                             */
+/*    The comms tasks, the master application task and the slave actuation     */
+/*    task of p3demo.c run as events in virtual time, joined by the virtual    */
+/*    serial line of p3uart.c.  Half way through the cable is pulled for a     */
+/*    while so the liveness detection and recovery can be timed.  Each of      */
+/*    the comma separated values given is tried against every other and        */
+/*    the configuration with the lowest control latency is picked out.         */
+/*                                                                             */
+/*    usage: p3sim [-f] [-b bauds] [-p polls] [-w windows] [-t tick]           */
+/*                 [-q quiet] [-x outage] [-s seconds]                         */
+/*    -f freshen the poll on each mirror reply as p3demo.c, polls then only    */
+/*       go out when mirroring stops so -p makes little difference             */
+/*    -b line rates                                                            */
+/*    -p motor status poll periods, -w reply timeouts, both in ticks           */
+/*    -t tick in uS, -x outage in mS, 0 for none                               */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3uart.h"
+
+// values one option can sweep over
+#define P3SIM_MAX_VALUES    16
+// tasks and one shot events in the queue
+#define P3SIM_MAX_EVENTS    16
+
+/*---------------------------------------------------------------------------*/
+/*  define application specific commands, as p3demo.c                        */
+/*---------------------------------------------------------------------------*/
+
+#define CMD2_STATUS_GETMOTORS           0x10
+
+static  p3cmd   Cmd_Motor_Status_Req    = { CMD1_GROUP_STATUS,  CMD2_STATUS_GETMOTORS,           0, {0} };
+static  p3cmd   Cmd_Motor_Status        = { CMD1_GROUP_STATUS_REPLY, CMD2_STATUS_GETMOTORS,     10, {0} };
+static  p3cmd   Cmd_Set_Motors          = { CMD1_GROUP_CONTROL, 0x10,                           10, {0} };
+
+#define MIRROR_MOTORS                   0
+
+/*---------------------------------------------------------------------------*/
+/*  Events, periodic tasks or one shots, run in time order                   */
+/*---------------------------------------------------------------------------*/
+
+typedef struct _p3simevent {
+    long long       at;         // nS
+    long long       period;     // 0 for a one shot
+    unsigned long   seq;        // events at the same time run in the order queued
+    void           (*run)( void );
+    } p3simevent;
+
+// one configuration
+typedef struct _p3simcfg {
+    long            baud;
+    int             poll;       // motor status period, ticks
+    int             window;     // reply timeout, ticks
+    } p3simcfg;
+
+// what one configuration did
+typedef struct _p3simresult {
+    unsigned long   polls;      // motor status replies
+    unsigned long   updates;    // motor commands applied by the slave
+    long long       latencySum; // master setting a value to the slave applying it
+    long long       latencyMax;
+    unsigned long   timeouts;   // with the cable in
+    long long       detect;     // cable pulled to master seeing the slave offline, -1 never
+    long long       recover;    // cable back to the slave online again, -1 never
+    double          busy;       // master to slave line use
+    int             refused;    // P3ScheduleAdd would not take the poll
+    } p3simresult;
+
+static  p3simevent     *queue[ P3SIM_MAX_EVENTS ];
+static  int             queueCount;
+static  unsigned long   queueSeq;
+
+static  p3simevent      events[ P3SIM_MAX_EVENTS ];
+static  int             eventCount;
+
+static  long long       now;            // virtual time, nS
+static  unsigned long   ticks;          // comms task calls, both ends
+
+static  p3uart          uart;
+static  p3comms        *master;
+static  p3comms        *slave;
+static  p3device       *slaveDev;
+static  p3cmdqueue      actuationQueue;
+static  p3simresult     result;
+
+// master application state
+static  unsigned char   joystick;       // value sent in motor 0, changes every run
+static  long long       changed[256];   // when each value was set
+static  int             mirrorCount;
+static  int             motorStatusSlot;
+static  int             freshen;        // poll freshened by mirror replies, -f
+
+// slave state
+static  unsigned char   motor[10];
+static  int             slaveMirrorCount;
+static  int             slaveSeen;      // last motor 0 value received, -1 none
+
+// outage
+static  long long       pulledAt;
+static  long long       replacedAt;
+static  unsigned long   pulledTimeouts;
+
+/*---------------------------------------------------------------------------*/
+/*  Event queue, a binary heap on time then order queued                     */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3SimBefore( p3simevent *a, p3simevent *b )
+{
+    return( a->at < b->at || (a->at == b->at && a->seq < b->seq) );
+}
+
+static void
+P3SimPush( p3simevent *ev )
+{
+    int     i = queueCount++;
+
+    ev->seq = queueSeq++;
+    while( i > 0 && P3SimBefore( ev, queue[ (i-1)/2 ] ) )
+        {
+        queue[i] = queue[ (i-1)/2 ];
+        i = (i-1)/2;
+        }
+    queue[i] = ev;
+}
+
+static p3simevent *
+P3SimPop( void )
+{
+    p3simevent  *top = queue[0];
+    p3simevent  *last = queue[ --queueCount ];
+    int          i = 0;
+    int          c;
+
+    while( (c = 2*i + 1) < queueCount )
+        {
+        if( c + 1 < queueCount && P3SimBefore( queue[c+1], queue[c] ) )
+            c++;
+        if( !P3SimBefore( queue[c], last ) )
+            break;
+        queue[i] = queue[c];
+        i = c;
+        }
+    queue[i] = last;
+
+    return( top );
+}
+
+static void
+P3SimAdd( long long at, long long period, void (*run)( void ) )
+{
+    p3simevent  *ev = &events[ eventCount++ ];
+
+    ev->at     = at;
+    ev->period = period;
+    ev->run    = run;
+    P3SimPush( ev );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Master - motor status reply, called by the comms task                    */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SimMotorStatusDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    (void)MyComms;
+    (void)reply;
+    (void)context;
+
+    if( status == kP3ReqReply )
+        result.polls++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave - fill in motor status, used for the prebuilt reply                */
+/*---------------------------------------------------------------------------*/
+
+int
+P3SimMotorStatus( p3comms *MyComms, p3cmd *reply )
+{
+    (void)MyComms;
+
+    memcpy( reply->data, motor, 10 );
+
+    return(1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave - status requests that arrive before the prebuilt reply is ready   */
+/*---------------------------------------------------------------------------*/
+
+int
+P3SimDecodeSlave( p3comms *MyComms, p3pak *packet )
+{
+    if( packet->masked_cmd1 != CMD1_GROUP_STATUS ||
+        packet->command.cmdpak.cmd.cmd2 != CMD2_STATUS_GETMOTORS )
+        return(0);
+
+    P3SimMotorStatus( MyComms, &Cmd_Motor_Status );
+    P3Command( MyComms, &Cmd_Motor_Status, packet->dev_id );
+
+    return(1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Tasks - master comms, notes when the slave drops out and comes back      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimMasterComms( void )
+{
+    P3CommsTask( master );
+    ticks++;
+
+    if( pulledAt > 0 && result.detect < 0 && slaveDev->online == 0 )
+        result.detect = now - pulledAt;
+
+    // timeouts while the cable was out are expected
+    if( replacedAt > 0 && result.recover < 0 && slaveDev->online != 0 )
+        {
+        result.recover = now - replacedAt;
+        pulledTimeouts = slaveDev->tcount - pulledTimeouts;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Slave - a new motor value arrived latency nS after it was set            */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimLatency( long long latency )
+{
+    result.updates++;
+    result.latencySum += latency;
+    if( latency > result.latencyMax )
+        result.latencyMax = latency;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Tasks - slave comms, queues mirrored motor commands and mirrors back     */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimSlaveComms( void )
+{
+    P3CommsTask( slave );
+    ticks++;
+
+    if( slave->MirrorRxCount != slaveMirrorCount )
+        {
+        slaveMirrorCount = slave->MirrorRxCount;
+        P3MirrorRead( slave, MIRROR_MOTORS, Cmd_Set_Motors.data, 10 );
+        P3QueuePut( &actuationQueue, &Cmd_Set_Motors );
+
+        // latency is the link's, from the app setting a value to the
+        // comms task having it, not when actuation next runs
+        if( Cmd_Set_Motors.data[0] != slaveSeen )
+            {
+            slaveSeen = Cmd_Set_Motors.data[0];
+            P3SimLatency( now - changed[ slaveSeen ] );
+            }
+        }
+
+    P3MirrorWrite( slave, MIRROR_MOTORS, motor, 10 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Tasks - master application, a new motor value every run                  */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimMasterApp( void )
+{
+    unsigned char   motors[10];
+
+    if( slaveDev->online == 0 )
+        return;
+
+    memset( motors, 0x7F, sizeof(motors) );
+    motors[0] = joystick;
+    changed[ joystick ] = now;
+    joystick++;
+
+    P3MirrorWrite( master, MIRROR_MOTORS, motors, 10 );
+    P3MirrorSync( master, CORTEX_DEVICE_ID );
+
+    // with -f as p3demo.c, a mirror reply carries the motor values so
+    // the status poll waits a full period again and the poll period
+    // hardly matters
+    if( master->MirrorRxCount != mirrorCount )
+        {
+        mirrorCount = master->MirrorRxCount;
+        if( freshen && motorStatusSlot >= 0 )
+            P3ScheduleFresh( master, motorStatusSlot );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Tasks - slave actuation, applies what the comms task queued              */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimActuation( void )
+{
+    p3cmd       cmd;
+
+    while( P3QueueGet( &actuationQueue, &cmd ) == P3_SUCCESS )
+        memcpy( motor, cmd.data, 10 );
+
+    P3Heartbeat( slave );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  One shots - pull the cable and put it back                               */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimPull( void )
+{
+    uart.broken    = 1;
+    pulledAt       = now;
+    pulledTimeouts = slaveDev->tcount;
+}
+
+static void
+P3SimReplace( void )
+{
+    uart.broken = 0;
+    replacedAt  = now;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run one configuration                                                    */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3SimRun( p3simcfg *cfg, long long tick, int quiet, long long outage, long long end )
+{
+    p3uartcfg    ucfg;
+    p3simevent  *ev;
+
+    memset( &result, 0, sizeof(result) );
+    result.detect  = -1;
+    result.recover = -1;
+    queueCount = eventCount = 0;
+    queueSeq   = 0;
+    now        = 0;
+    pulledAt   = replacedAt = 0;
+    joystick   = 0;
+    mirrorCount = slaveMirrorCount = 0;
+    slaveSeen   = -1;
+    memset( motor, 0x7F, sizeof(motor) );
+    P3QueueInit( &actuationQueue );
+
+    memset( &ucfg, 0, sizeof(ucfg) );
+    ucfg.baud   = cfg->baud;
+    ucfg.parity = 1;
+    ucfg.txFifo = 256;
+    ucfg.rxFifo = 256;
+    P3UartInit( &uart, &ucfg );
+
+    master = P3UartOpen( &uart, 0, kP3ModeMaster, 0 );
+    slave  = P3UartOpen( &uart, 1, kP3ModeSlave,  0 );
+    if( master == NULL || slave == NULL )
+        exit(1);
+
+    // master as serialMasterInit, with the poll period and reply window tried
+    slaveDev = P3GetDevice( master, CORTEX_DEVICE_ID );
+    slaveDev->timeout = cfg->window;
+    P3SetLiveness( master, CORTEX_DEVICE_ID, quiet );
+    motorStatusSlot = P3ScheduleAdd( master, CORTEX_DEVICE_ID, &Cmd_Motor_Status_Req, 10, cfg->poll, P3SimMotorStatusDone, NULL );
+    if( motorStatusSlot >= 0 )
+        P3SchedulePriority( master, motorStatusSlot, 1 );
+    else
+        result.refused = 1;
+
+    // slave as serialCommsTaskS
+    P3SetAddress( slave, CORTEX_DEVICE_ID );
+    slave->deviceType[0] = 0x12;
+    slave->deviceType[1] = 0x34;
+    P3SetReplyDecoder( slave, P3SimDecodeSlave );
+    P3RegisterPrebuilt( slave, CMD1_GROUP_STATUS, CMD2_STATUS_GETMOTORS, &Cmd_Motor_Status, P3SimMotorStatus );
+
+    // the tasks at the rates p3demo.c uses, the slave half a tick out of step
+    P3SimAdd( 0,                tick,       P3SimMasterComms );
+    P3SimAdd( tick / 2,         tick,       P3SimSlaveComms );
+    P3SimAdd( 0,                10000000,   P3SimMasterApp );
+    P3SimAdd( 0,                5000000,    P3SimActuation );
+    if( outage > 0 )
+        {
+        P3SimAdd( end / 2,          0, P3SimPull );
+        P3SimAdd( end / 2 + outage, 0, P3SimReplace );
+        }
+
+    while( queueCount > 0 && queue[0]->at < end )
+        {
+        ev  = P3SimPop();
+        now = ev->at;
+
+        // bytes that arrive by now are waiting in the fifos
+        P3UartAdvance( &uart, now );
+        ev->run();
+
+        if( ev->period > 0 )
+            {
+            ev->at += ev->period;
+            P3SimPush( ev );
+            }
+        }
+
+    result.timeouts = slaveDev->tcount - (result.recover >= 0 ? pulledTimeouts : 0);
+    result.busy     = uart.dir[0].active * 100.0 / end;
+
+    P3Deinit( master );
+    P3Deinit( slave );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Comma separated list of values                                           */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3SimList( char *arg, long *values )
+{
+    int     n = 0;
+    char   *p;
+
+    for( p = strtok( arg, "," ); p != NULL && n < P3SIM_MAX_VALUES; p = strtok( NULL, "," ) )
+        values[n++] = atol( p );
+
+    return( n );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  A time in mS for the table, - for never                                  */
+/*---------------------------------------------------------------------------*/
+
+static char *
+P3SimTime( char *buf, long long t )
+{
+    if( t < 0 )
+        strcpy( buf, "-" );
+    else
+        sprintf( buf, "%.1f", t / 1e6 );
+
+    return( buf );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Try every combination and report                                         */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    long         bauds[ P3SIM_MAX_VALUES ]   = { 57600, 115200, 230400 };
+    long         polls[ P3SIM_MAX_VALUES ]   = { 10, 25, 50 };
+    long         windows[ P3SIM_MAX_VALUES ] = { 3, 5, 10 };
+    int          nb = 3, np = 3, nw = 3;
+    long long    tick    = P3_TICK_US;
+    long long    outage  = 1000;
+    long long    seconds = 20;
+    int          quiet   = P3_LIVENESS_QUIET;
+    p3simcfg     cfg;
+    p3simcfg     best = { 0, 0, 0 };
+    double       bestLatency = -1;
+    long long    bestDetect  = 0;
+    char         polled[16];
+    char         detect[16];
+    char         recover[16];
+    double       latency;
+    unsigned long total = 0;
+    struct timespec t0, t1;
+    double       wall;
+    int          b, p, w;
+    int          c;
+
+    while( (c = getopt( argc, argv, "fb:p:w:t:q:x:s:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'f':   freshen = 1;                        break;
+            case 'b':   nb = P3SimList( optarg, bauds );     break;
+            case 'p':   np = P3SimList( optarg, polls );     break;
+            case 'w':   nw = P3SimList( optarg, windows );   break;
+            case 't':   tick    = atoll( optarg );          break;
+            case 'q':   quiet   = atoi( optarg );           break;
+            case 'x':   outage  = atoll( optarg );          break;
+            case 's':   seconds = atoll( optarg );          break;
+            default:
+                fprintf(stderr, "usage: %s [-f] [-b bauds] [-p polls] [-w windows] [-t tick] [-q quiet]\n", argv[0] );
+                fprintf(stderr, "       [-x outage] [-s seconds]\n" );
+                return(1);
+            }
+        }
+
+    if( nb == 0 || np == 0 || nw == 0 || tick <= 0 || seconds <= 0 )
+        return(1);
+
+    printf("tick %lld uS, quiet %d ticks, outage %lld mS at %lld S, %lld S each%s\n",
+            tick, quiet, outage, seconds / 2, seconds, freshen ? ", poll freshened" : "" );
+    printf("  baud   poll window  polls/s  latency mS mean   max  timeouts  detect mS  recover mS  line\n");
+
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+
+    for(b=0;b<nb;b++)
+        for(p=0;p<np;p++)
+            for(w=0;w<nw;w++)
+                {
+                cfg.baud   = bauds[b];
+                cfg.poll   = polls[p];
+                cfg.window = windows[w];
+                if( cfg.baud <= 0 || cfg.poll <= 0 || cfg.window <= 0 )
+                    continue;
+
+                P3SimRun( &cfg, tick * 1000, quiet, outage * 1000000, seconds * 1000000000LL );
+                total += ticks;
+                ticks  = 0;
+
+                latency = result.updates ? result.latencySum / 1e6 / result.updates : -1;
+
+                if( result.refused )
+                    strcpy( polled, "refused" );
+                else
+                    sprintf( polled, "%.1f", result.polls / (double)seconds );
+
+                printf("%6ld %6d %6d %8s %15.2f %6.2f %9lu %10s %11s %4.1f%%\n",
+                        cfg.baud, cfg.poll, cfg.window, polled,
+                        latency, result.latencyMax / 1e6, result.timeouts,
+                        P3SimTime( detect, result.detect ), P3SimTime( recover, result.recover ),
+                        result.busy );
+
+                // lowest latency that never times out with the cable in,
+                // then the quickest to notice the cable pulled
+                if( latency < 0 || result.refused || result.timeouts != 0 ||
+                   (outage > 0 && result.recover < 0) )
+                    continue;
+                if( bestLatency < 0 || latency < bestLatency ||
+                   (latency == bestLatency && result.detect < bestDetect) )
+                    {
+                    bestLatency = latency;
+                    bestDetect  = result.detect;
+                    best = cfg;
+                    }
+                }
+
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if( bestLatency >= 0 )
+        printf("best: baud %ld poll %d window %d, latency %.2f mS\n",
+                best.baud, best.poll, best.window, bestLatency );
+    else
+        printf("best: none ran without timeouts\n");
+
+    printf("%lu comms task calls in %.2f S, %.0f a second\n", total, wall, total / wall );
+
+    return(0);
+}
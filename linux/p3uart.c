@@ -0,0 +1,427 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3uart.c                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Virtual serial line for running p3comms without a cortex                 */
+/*                                                                             */
+/*    P3UartOpen gives a p3comms whose callbacks read and write one end of     */
+/*    the line.  Nothing moves until P3UartAdvance is called, bytes then       */
+/*    cross one at a time at the line rate, 10 or 11 bits each with an         */
+/*    optional gap between them, from the transmit fifo of one end to the      */
+/*    receive fifo of the other.  Writes to a full transmit fifo are dropped   */
+/*    and bytes arriving at a full receive fifo are lost as an overrun would   */
+/*    lose them.  Setting broken loses everything sent, as a pulled cable      */
+/*    would.  Time is virtual so a run is the same every time.                 */
+/*                                                                             */
+/*    P3UartFaults adds noise between the ends, from a seeded generator so     */
+/*    faults repeat too.  Flipped bits are checked as the uart would, a        */
+/*    start or stop bit error or, with parity, an odd number of flipped bits   */
+/*    loses the byte and anything else is delivered corrupt.                   */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3uart.h"
+
+/*---------------------------------------------------------------------------*/
+/*  Callbacks - write to the transmit fifo                                   */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UartWrite( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    p3uartend   *end  = (p3uartend *)MyComms->sdp;
+    p3uart      *uart = end->uart;
+    p3uartdir   *d    = &uart->dir[ end->side ];
+    int          i;
+
+    // line idle, the first byte starts now
+    if( d->txCount == 0 && d->busy < uart->now )
+        d->busy = uart->now;
+
+    for(i=0;i<data_len;i++)
+        {
+        if( d->txCount >= uart->cfg.txFifo )
+            {
+            d->dropped++;
+            continue;
+            }
+        d->tx[ (d->txHead + d->txCount++) % P3U_FIFO_MAX ] = data[i];
+        }
+
+    return(0);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Callbacks - see if there is anything in the receive fifo                 */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UartPeek( p3comms *MyComms )
+{
+    p3uartend   *end = (p3uartend *)MyComms->sdp;
+
+    if( end->uart->dir[ end->side ^ 1 ].rxCount > 0 )
+        return(0);
+    else
+        return(-1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Callbacks - read everything in the receive fifo, never blocks            */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UartRead( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    p3uartend   *end = (p3uartend *)MyComms->sdp;
+    p3uartdir   *d   = &end->uart->dir[ end->side ^ 1 ];
+    int          n   = 0;
+
+    while( n < data_len && d->rxCount > 0 )
+        {
+        data[n++] = d->rx[ d->rxHead ];
+        d->rxHead = (d->rxHead + 1) % P3U_FIFO_MAX;
+        d->rxCount--;
+        }
+
+    return(n);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Callbacks - one byte from the receive fifo                               */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UartGetByte( p3comms *MyComms )
+{
+    unsigned char c;
+
+    if( P3UartRead( MyComms, &c, 1 ) == 1 )
+        return(c);
+    else
+        return(-1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Faults - xorshift64*, a number from 0 up to 1                            */
+/*---------------------------------------------------------------------------*/
+
+static double
+P3UartRandom( p3uart *uart )
+{
+    uart->random ^= uart->random >> 12;
+    uart->random ^= uart->random << 25;
+    uart->random ^= uart->random >> 27;
+
+    return( ((uart->random * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Faults - put a byte in the receive fifo                                  */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UartDeliver( p3uart *uart, p3uartdir *d, unsigned char c )
+{
+    if( d->rxCount >= uart->cfg.rxFifo )
+        d->overruns++;
+    else
+        {
+        d->rx[ (d->rxHead + d->rxCount++) % P3U_FIFO_MAX ] = c;
+        d->bytes++;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Faults - bits of one byte to flip, bit 0 the start bit, 1 to 8 data,     */
+/*  then parity if used and the stop bit                                     */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3UartFlips( p3uart *uart, p3uartdir *d, int bits )
+{
+    p3uartfault *f = &uart->fault;
+    double       clean;
+    int          flips = 0;
+    int          i;
+
+    // a burst garbles every bit at random
+    if( d->burstLeft == 0 && f->burst > 0 && P3UartRandom( uart ) < f->burst )
+        d->burstLeft = f->burstLen;
+    if( d->burstLeft > 0 )
+        {
+        d->burstLeft--;
+        while( flips == 0 )
+            flips = (int)(P3UartRandom( uart ) * (1 << bits));
+        return( flips );
+        }
+
+    if( f->ber <= 0 )
+        return( 0 );
+
+    // one draw for a clean byte, the usual case
+    for( clean = 1.0, i = 0; i < bits; i++ )
+        clean *= 1.0 - f->ber;
+    if( P3UartRandom( uart ) < clean )
+        return( 0 );
+
+    // at least one bit, any others as likely as ever
+    flips = 1 << (int)(P3UartRandom( uart ) * bits);
+    for(i=0;i<bits;i++)
+        if( P3UartRandom( uart ) < f->ber )
+            flips |= 1 << i;
+
+    return( flips );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Faults - pass a byte through the noise, at is when it finished           */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3UartNoise( p3uart *uart, p3uartdir *d, unsigned char c, long long at )
+{
+    p3uartfault *f = &uart->fault;
+    int          bits = uart->cfg.parity ? 11 : 10;
+    int          flips;
+    int          data;
+    int          parity;
+    int          deliver = 1;
+    int          faults = 0;
+    int          n;
+    int          i;
+
+    // stuck line, nothing gets through until it frees
+    if( f->stuckEvery > 0 )
+        {
+        if( at >= d->stuckAt + f->stuckFor )
+            d->stuckAt = at + (long long)(P3UartRandom( uart ) * 2 * f->stuckEvery);
+        if( at >= d->stuckAt )
+            {
+            d->stuck++;
+            if( d->faultAt < 0 )
+                d->faultAt = at;
+            return;
+            }
+        }
+
+    if( f->drop > 0 && P3UartRandom( uart ) < f->drop )
+        {
+        d->vanished++;
+        faults++;
+        }
+    else
+        {
+        if( f->preamble > 0 && P3UartRandom( uart ) < f->preamble )
+            {
+            P3UartDeliver( uart, d, P3_PREAMBLE1 );
+            d->inserted++;
+            faults++;
+            }
+
+        if( (flips = P3UartFlips( uart, d, bits )) != 0 )
+            {
+            faults++;
+            data   = (flips >> 1) & 0xFF;
+            parity = uart->cfg.parity ? (flips >> 9) & 1 : 0;
+
+            // count the data and parity bits flipped
+            for( n = parity, i = data; i != 0; i &= i - 1 )
+                n++;
+
+            // start or stop bit is a framing error, parity catches an odd number
+            if( (flips & 1) || ((flips >> (bits - 1)) & 1) || (uart->cfg.parity && (n & 1)) )
+                {
+                d->rejected++;
+                deliver = 0;
+                }
+            else
+                {
+                c ^= data;
+                d->corrupted++;
+                }
+            }
+
+        if( deliver )
+            {
+            P3UartDeliver( uart, d, c );
+            if( f->dup > 0 && P3UartRandom( uart ) < f->dup )
+                {
+                P3UartDeliver( uart, d, c );
+                d->doubled++;
+                faults++;
+                }
+            }
+        }
+
+    if( faults && d->faultAt < 0 )
+        d->faultAt = at;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Add faults to both directions of a line                                  */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UartFaults( p3uart *uart, p3uartfault *fault )
+{
+    int     s;
+
+    uart->fault  = *fault;
+    uart->faulty = 1;
+
+    // never zero or the generator sticks
+    uart->random = fault->seed ? fault->seed : 0x9E3779B97F4A7C15ULL;
+
+    for(s=0;s<2;s++)
+        {
+        uart->dir[s].burstLeft = 0;
+        uart->dir[s].stuckAt   = fault->stuckEvery > 0 ?
+                                 (long long)(P3UartRandom( uart ) * 2 * fault->stuckEvery) : 0;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Set up a line, both ends idle at time 0                                  */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UartInit( p3uart *uart, p3uartcfg *cfg )
+{
+    int     bits;
+
+    memset( uart, 0, sizeof(p3uart) );
+    uart->cfg = *cfg;
+
+    if( uart->cfg.txFifo <= 0 || uart->cfg.txFifo > P3U_FIFO_MAX )
+        uart->cfg.txFifo = P3U_FIFO_MAX;
+    if( uart->cfg.rxFifo <= 0 || uart->cfg.rxFifo > P3U_FIFO_MAX )
+        uart->cfg.rxFifo = P3U_FIFO_MAX;
+
+    // start bit, 8 data bits, parity and stop bit
+    bits = uart->cfg.parity ? 11 : 10;
+    uart->byteTime = (bits * 1000000000LL + uart->cfg.baud / 2) / uart->cfg.baud;
+
+    uart->end[0].uart = uart;
+    uart->end[0].side = 0;
+    uart->end[1].uart = uart;
+    uart->end[1].side = 1;
+
+    uart->dir[0].faultAt = -1;
+    uart->dir[1].faultAt = -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  A p3comms on one end of the line, side 0 or 1                            */
+/*---------------------------------------------------------------------------*/
+
+p3comms *
+P3UartOpen( p3uart *uart, int side, p3mode mode, int debug_flag )
+{
+    p3comms *MyComms;
+
+    if( (MyComms = P3Init( -1, mode, debug_flag, uart->cfg.baud )) == NULL )
+        return( NULL );
+
+    MyComms->sdp        = &uart->end[ side & 1 ];
+    MyComms->init       = NULL;
+    MyComms->deinit     = NULL;
+    MyComms->flush      = NULL;
+    MyComms->write_buf  = P3UartWrite;
+    MyComms->peek_input = P3UartPeek;
+    MyComms->get_byte   = P3UartGetByte;
+    MyComms->read_buf   = P3UartRead;
+
+    return( MyComms );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Move virtual time on, delivering every byte that finishes by then        */
+/*---------------------------------------------------------------------------*/
+
+void
+P3UartAdvance( p3uart *uart, long long until )
+{
+    p3uartdir   *d;
+    int          s;
+
+    for(s=0;s<2;s++)
+        {
+        d = &uart->dir[s];
+
+        while( d->txCount > 0 && d->busy + uart->byteTime <= until )
+            {
+            d->busy   += uart->byteTime;
+            d->active += uart->byteTime;
+
+            if( uart->broken )
+                d->lost++;
+            else
+            if( uart->faulty )
+                P3UartNoise( uart, d, d->tx[ d->txHead ], d->busy );
+            else
+                P3UartDeliver( uart, d, d->tx[ d->txHead ] );
+
+            d->txHead = (d->txHead + 1) % P3U_FIFO_MAX;
+            d->txCount--;
+
+            d->busy += uart->cfg.gap;
+            }
+        }
+
+    if( until > uart->now )
+        uart->now = until;
+}
+
+/*---------------------------------------------------------------------------*/
+/*  When the next byte arrives at either end, -1 if the line is idle         */
+/*---------------------------------------------------------------------------*/
+
+long long
+P3UartNext( p3uart *uart )
+{
+    p3uartdir   *d;
+    long long    next = -1;
+    int          s;
+
+    for(s=0;s<2;s++)
+        {
+        d = &uart->dir[s];
+        if( d->txCount > 0 && (next < 0 || d->busy + uart->byteTime < next) )
+            next = d->busy + uart->byteTime;
+        }
+
+    return( next );
+}
@@ -0,0 +1,119 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3uart.h                                                     */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Header for p3uart.c                                                      */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#ifndef P3UART_H_
+#define P3UART_H_
+
+// most bytes either fifo can be set to hold
+#ifndef P3U_FIFO_MAX
+#define P3U_FIFO_MAX        4096
+#endif
+
+// line settings, a fifo size of 0 is the largest
+typedef struct _p3uartcfg {
+    long                    baud;
+    int                     parity;     // odd parity as the cortex uses, 11 bits a byte not 10
+    int                     txFifo;     // bytes the transmitter holds, more are dropped
+    int                     rxFifo;     // bytes the receiver holds, more are overrun
+    long                    gap;        // idle time between bytes, nS
+    } p3uartcfg;
+
+// faults added as bytes arrive, probabilities are for each byte except ber
+typedef struct _p3uartfault {
+    double                  ber;        // each bit flipped, start, data, parity and stop
+    double                  burst;      // a burst of errors starts
+    int                     burstLen;   // bytes a burst corrupts
+    double                  drop;       // byte lost
+    double                  dup;        // byte received twice
+    double                  preamble;   // spurious P3_PREAMBLE1 received before the byte
+    long long               stuckEvery; // mean time between the line sticking, nS, 0 for never
+    long long               stuckFor;   // how long it stays stuck, nS
+    unsigned long long      seed;       // same seed, same faults
+    } p3uartfault;
+
+// one direction of the line
+typedef struct _p3uartdir {
+    unsigned char           tx[ P3U_FIFO_MAX ];
+    int                     txHead;
+    int                     txCount;
+    long long               busy;       // when the line is next free, nS
+    unsigned char           rx[ P3U_FIFO_MAX ];
+    int                     rxHead;
+    int                     rxCount;
+
+    unsigned long           bytes;      // delivered
+    unsigned long           dropped;    // written with the tx fifo full
+    unsigned long           overruns;   // arrived with the rx fifo full
+    unsigned long           lost;       // sent with the line broken
+    long long               active;     // time the line was sending, nS
+
+    // faults
+    unsigned long           corrupted;  // delivered with bits flipped
+    unsigned long           rejected;   // parity or framing error, not delivered
+    unsigned long           vanished;   // dropped by the fault stage
+    unsigned long           doubled;
+    unsigned long           inserted;   // spurious preambles
+    unsigned long           stuck;      // sent while the line was stuck
+    int                     burstLeft;
+    long long               stuckAt;    // next time the line sticks
+    long long               faultAt;    // first fault since the user cleared it, -1 for none
+    } p3uartdir;
+
+// one end of the line, the sdp of the p3comms using it
+typedef struct _p3uartend {
+    struct _p3uart         *uart;
+    int                     side;
+    } p3uartend;
+
+// a virtual serial line between two p3comms in one process
+typedef struct _p3uart {
+    p3uartcfg               cfg;
+    long long               now;        // virtual time, nS
+    long long               byteTime;   // nS on the wire for one byte
+    int                     broken;     // cable pulled, bytes go nowhere
+    int                     faulty;     // fault set, see P3UartFaults
+    p3uartfault             fault;
+    unsigned long long      random;
+    p3uartdir               dir[2];     // dir[n] carries what end n writes
+    p3uartend               end[2];
+    } p3uart;
+
+void        P3UartInit( p3uart *uart, p3uartcfg *cfg );
+p3comms *   P3UartOpen( p3uart *uart, int side, p3mode mode, int debug_flag );
+void        P3UartFaults( p3uart *uart, p3uartfault *fault );
+void        P3UartAdvance( p3uart *uart, long long until );
+long long   P3UartNext( p3uart *uart );
+
+#endif /* P3UART_H_ */
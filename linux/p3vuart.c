@@ -0,0 +1,210 @@
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Module:     p3vuart.c                                                    */
+/*    Author:     p3comms Linux host contributors                              */
+/*    Created:    19 October 2026                                              */
+/*                                                                             */
+/*    Revisions:                                                               */
+/*                V1.00  19 Oct 2026 - Initial release for Linux               */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    This software is supplied for use with the VEX cortex control system.    */
+/*    This file can be freely distributed and teams are authorized to freely   */
+/*    use this program, however, it is requested that improvements or          */
+/*    additions be shared with the Vex community via the vex forum.            */
+/*    Thanks.                                                                  */
+/*                                                                             */
+/*    Licensed under the Apache License, Version 2.0 (the "License");          */
+/*    you may not use this file except in compliance with the License.         */
+/*    You may obtain a copy of the License at                                  */
+/*                                                                             */
+/*      http://www.apache.org/licenses/LICENSE-2.0                             */
+/*                                                                             */
+/*    Unless required by applicable law or agreed to in writing, software      */
+/*    distributed under the License is distributed on an "AS IS" BASIS,        */
+/*    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. */
+/*    See the License for the specific language governing permissions and      */
+/*    limitations under the License.                                           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+/*                                                                             */
+/*    Description:                                                             */
+/*    Master and slave in one process on a virtual serial line, see p3uart.c   */
+/*    Each runs at its own period in virtual time and the master sends the     */
+/*    next request as soon as the reply arrives, so the link throughput and    */
+/*    request latency come out the same on every run.                          */
+/*                                                                             */
+/*    usage: p3vuart [-d] [-n] [-b baud] [-r rxfifo] [-w txfifo] [-g gap]      */
+/*                   [-m period] [-p period] [-o offset] [-s seconds]          */
+/*    -n no parity, 10 bits a byte                                             */
+/*    -g gap between bytes in nS                                               */
+/*    -m and -p master and slave periods, -o slave offset, all in uS           */
+/*                                                                             */
+/*-----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "p3comms.h"    // p3comms header
+#include "p3uart.h"
+
+static  p3cmd   Cmd_Dev_Type            = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
+
+static  p3uart      uart;
+
+static  long long       sent;           // virtual time the request went in
+static  unsigned long   replies;
+static  unsigned long   timeouts;
+static  long long       latencySum;
+static  long long       latencyMin = -1;
+static  long long       latencyMax;
+
+/*---------------------------------------------------------------------------*/
+/*  Reply arrived, time it and send the next request                         */
+/*---------------------------------------------------------------------------*/
+
+void
+P3VuartDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    long long   latency = uart.now - sent;
+
+    (void)reply;
+    (void)context;
+
+    if( status == kP3ReqReply )
+        {
+        replies++;
+        latencySum += latency;
+        if( latencyMin < 0 || latency < latencyMin )
+            latencyMin = latency;
+        if( latency > latencyMax )
+            latencyMax = latency;
+        }
+    else
+        timeouts++;
+
+    sent = uart.now;
+    P3Request( MyComms, &Cmd_Dev_Type, CORTEX_DEVICE_ID, P3VuartDone, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run one end for the whole ticks since it last ran, as p3loop does        */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3VuartRun( p3comms *MyComms, long long *last, long long now )
+{
+    long    elapsed;
+
+    elapsed  = (long)((now - *last) / (P3_TICK_US * 1000LL));
+    *last   += (long long)elapsed * P3_TICK_US * 1000LL;
+
+    P3CommsRun( MyComms, elapsed );
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Run the line for a while in virtual time                                 */
+/*---------------------------------------------------------------------------*/
+
+int
+main( int argc, char **argv )
+{
+    p3comms     *master;
+    p3comms     *slave;
+    p3uartcfg    cfg;
+    long long    masterPeriod = P3_TICK_US;
+    long long    slavePeriod  = P3_TICK_US;
+    long long    offset  = 0;
+    long long    seconds = 10;
+    long long    end;
+    long long    masterNext, masterLast;
+    long long    slaveNext,  slaveLast;
+    double       secs;
+    int          debug = 0;
+    int          c;
+
+    memset( &cfg, 0, sizeof(cfg) );
+    cfg.baud   = 230400;
+    cfg.parity = 1;
+    cfg.txFifo = 256;
+    cfg.rxFifo = 256;
+
+    while( (c = getopt( argc, argv, "dnb:r:w:g:m:p:o:s:" )) != -1 )
+        {
+        switch( c )
+            {
+            case 'd':   debug = 1;                          break;
+            case 'n':   cfg.parity = 0;                     break;
+            case 'b':   cfg.baud   = atol( optarg );        break;
+            case 'r':   cfg.rxFifo = atoi( optarg );        break;
+            case 'w':   cfg.txFifo = atoi( optarg );        break;
+            case 'g':   cfg.gap    = atol( optarg );        break;
+            case 'm':   masterPeriod = atoll( optarg );     break;
+            case 'p':   slavePeriod  = atoll( optarg );     break;
+            case 'o':   offset     = atoll( optarg );       break;
+            case 's':   seconds    = atoll( optarg );       break;
+            default:
+                fprintf(stderr, "usage: %s [-d] [-n] [-b baud] [-r rxfifo] [-w txfifo] [-g gap]\n", argv[0] );
+                fprintf(stderr, "       [-m period] [-p period] [-o offset] [-s seconds]\n" );
+                return(1);
+            }
+        }
+
+    if( cfg.baud <= 0 || masterPeriod <= 0 || slavePeriod <= 0 || offset < 0 )
+        return(1);
+
+    P3UartInit( &uart, &cfg );
+
+    master = P3UartOpen( &uart, 0, kP3ModeMaster, debug );
+    slave  = P3UartOpen( &uart, 1, kP3ModeSlave,  debug );
+    if( master == NULL || slave == NULL )
+        return(1);
+
+    master->DebugTx = master->DebugRx = debug;
+    slave->DebugTx  = slave->DebugRx  = debug;
+
+    slave->deviceType[0] = 0x12;
+    slave->deviceType[1] = 0x34;
+    P3SetAddress( slave, CORTEX_DEVICE_ID );
+
+    P3Request( master, &Cmd_Dev_Type, CORTEX_DEVICE_ID, P3VuartDone, NULL );
+
+    // everything in nS from here
+    masterNext = masterLast = 0;
+    slaveNext  = slaveLast  = offset * 1000;
+    end = seconds * 1000000000LL;
+
+    while( uart.now < end )
+        {
+        // whichever end is due first, bytes that arrive by then are waiting
+        if( masterNext <= slaveNext )
+            {
+            P3UartAdvance( &uart, masterNext );
+            P3VuartRun( master, &masterLast, masterNext );
+            masterNext += masterPeriod * 1000;
+            }
+        else
+            {
+            P3UartAdvance( &uart, slaveNext );
+            P3VuartRun( slave, &slaveLast, slaveNext );
+            slaveNext += slavePeriod * 1000;
+            }
+        }
+
+    secs = uart.now / 1e9;
+
+    printf("baud %ld, %d bits, fifos tx %d rx %d, gap %ld nS, periods %lld/%lld uS, offset %lld uS\n",
+            cfg.baud, cfg.parity ? 11 : 10, uart.cfg.txFifo, uart.cfg.rxFifo, cfg.gap,
+            masterPeriod, slavePeriod, offset );
+    printf("  requests/s %.1f  latency uS mean %.0f min %.0f max %.0f  timeouts %lu\n",
+            replies / secs, replies ? latencySum / 1e3 / replies : 0.0,
+            latencyMin < 0 ? 0.0 : latencyMin / 1e3, latencyMax / 1e3, timeouts );
+    printf("  line busy m->s %.1f%% s->m %.1f%%  bytes/s %.0f/%.0f  overruns %lu/%lu  dropped %lu/%lu\n",
+            uart.dir[0].active / (secs * 1e7), uart.dir[1].active / (secs * 1e7),
+            uart.dir[0].bytes / secs, uart.dir[1].bytes / secs,
+            uart.dir[0].overruns, uart.dir[1].overruns, uart.dir[0].dropped, uart.dir[1].dropped );
+
+    return(0);
+}
@@ -59,6 +59,17 @@
 #include "ch.h"         // needs for all ChibiOS programs
 #include "hal.h"        // hardware abstraction layer header
 #include "vex.h"        // vex library header
+#elif defined(_TARGET_LINUX_)
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>   // termios2 for any baud rate
 #else
 #include "main.h"       // vex library header
 #endif
@@ -66,18 +77,22 @@
 #include "p3comms.h"    // p3comms header
 
 // Standard system replies
-//static  p3cmd   Cmd_Ack                     = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_ACK,          0x01, {0x00} };
+static  p3cmd   Cmd_Ack                     = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_ACK,          0x01, {0x00} };
 static  p3cmd   Cmd_Nak_Und                 = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x01} };
 static  p3cmd   Cmd_Nak_Chksum              = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x04} };
-//static  p3cmd   Cmd_Nak_Para_Err            = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x08} };
+static  p3cmd   Cmd_Nak_Para_Err            = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x08} };
 static  p3cmd   Cmd_Nak_Timeout             = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x80} };
 
-static  p3cmd   Cmd_Dev_Type_Reply          = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_DEVICE_TYPE,  0x02, {0x22, 0xC0} };
+// Liveness probe, the reply also refreshes the fingerprint
+static  p3cmd   Cmd_Probe                   = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
+
+static  p3cmd   Cmd_Dev_Type_Reply          = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_DEVICE_TYPE,  0x06, {0x22, 0xC0} };
 static  p3cmd   Cmd_Manufacturer_Reply      = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_MANUFACTURER, 0x00, {0x00} };
 static  p3cmd   Cmd_ProductName_Reply       = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_PRODUCT_NAME, 0x00, {0x00} };
 static  p3cmd   Cmd_SerialNumber_Reply      = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_SERIAL_NUM,   0x00, {0x00} };
 static  p3cmd   Cmd_FirmwareVersion_Reply   = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_FIRMWARE,     0x05, {0x00, 0x00, 0x00, 0x00, 0x00} };
 static  p3cmd   Cmd_HardwareVersion_Reply   = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_HARDWARE,     0x03, {0x00, 0x00, 0x00} };
+static  p3cmdfull   Cmd_Identify_Reply      = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_IDENTIFY,     0x00, {0x00} };
 
 // System commands
 //static  p3cmd   Cmd_Dev_Type                = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
@@ -86,7 +101,27 @@ static  p3cmd   Cmd_HardwareVersion_Reply   = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SY
 //static  p3cmd   Cmd_SerialNumber_Request    = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_SERIAL_NUM,   0, {0x00} };
 //static  p3cmd   Cmd_FirmwareRev_Request     = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_FIRMWARE,     0, {0x00} };
 //static  p3cmd   Cmd_HardwareRev_Request     = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_HARDWARE,     0, {0x00} };
+//static  p3cmd   Cmd_Identify                = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_IDENTIFY,     0, {0x00} };
+
+// Mirror sync and reply, these are built on the fly
+static  p3cmdfull   Cmd_Mirror_Sync         = { CMD1_GROUP_MIRROR,       CMD2_MIRROR_SYNC,         0x00, {0x00} };
+static  p3cmdfull   Cmd_Mirror_Reply        = { CMD1_GROUP_MIRROR_REPLY, CMD2_MIRROR_SYNC,         0x00, {0x00} };
+
+// Dirty maps are shared between the application and comms tasks
+#define P3_ATOMIC_OR(p, v)          __sync_fetch_and_or( (p), (v) )
+#define P3_ATOMIC_AND(p, v)         __sync_fetch_and_and( (p), (v) )
+#define P3_MIRROR_TEST(map, i)      ((map)[(i) >> 5] & (1U << ((i) & 31)))
+
+// Order memory accesses between tasks
+#define P3_MEMORY_BARRIER()         __sync_synchronize()
 
+static  void    P3MirrorEncode( p3mirror *mirror, p3cmdfull *cmd );
+static  int     P3IdentifyPutString( unsigned char *p, unsigned char *str );
+static  int     P3IdentifyGetString( unsigned char *str, unsigned char *p, int avail );
+static  void    P3ReplyString( p3identity *id, unsigned char *str, p3pak *packet );
+static  void    P3StringReply( p3cmd *reply, unsigned char *str );
+static  void    P3CompleteRequest( p3comms *MyComms, p3pak *reply, p3reqstatus status );
+static  void    P3BuildPrebuilt( p3comms *MyComms, p3prebuilt *pb );
 
 /*---------------------------------------------------------------------------*/
 /*  ConVEX glue code                                                         */
@@ -158,6 +193,146 @@ serial_writebuf( p3comms *MyComms, unsigned char *data, int data_len )
     return(0);
 }
 
+#elif defined(_TARGET_LINUX_)
+/*---------------------------------------------------------------------------*/
+/*  Linux glue code                                                          */
+/*  sdp is the device name, USB serial adapters are usually /dev/ttyUSBn     */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_init( p3comms *MyComms, long baud )
+{
+    struct termios2 tio;
+
+    MyComms->fd = -1;
+
+    if( MyComms->sdp == NULL )
+        return(0);
+
+    if( (MyComms->fd = open( (char *)MyComms->sdp, O_RDWR | O_NOCTTY | O_NONBLOCK )) < 0 )
+        return(0);
+
+    if( ioctl( MyComms->fd, TCGETS2, &tio ) < 0 )
+        {
+        close( MyComms->fd );
+        MyComms->fd = -1;
+        return(0);
+        }
+
+    // raw 8 bits, odd parity and one stop bit, bytes with parity
+    // errors are dropped and the checksum catches the frame
+    tio.c_iflag = IGNBRK | INPCK | IGNPAR;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | PARENB | PARODD | BOTHER;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    tio.c_cc[VMIN]  = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if( ioctl( MyComms->fd, TCSETS2, &tio ) < 0 )
+        {
+        close( MyComms->fd );
+        MyComms->fd = -1;
+        return(0);
+        }
+
+    return(1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Close the device                                                         */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_deinit( p3comms *MyComms )
+{
+    if( MyComms->fd >= 0 )
+        close( MyComms->fd );
+    MyComms->fd = -1;
+
+    return(0);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Peek to see if there are characters in the receive FIFO                  */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_peekinput(p3comms *MyComms)
+{
+    int     count;
+
+    // get number of chars available
+    if( ioctl( MyComms->fd, FIONREAD, &count ) < 0 || count <= 0 )
+        return(-1);
+    else
+        return(0);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Get next character from the receive FIFO                                 */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_getchar(p3comms *MyComms)
+{
+    unsigned char c;
+
+    if( read( MyComms->fd, &c, 1 ) == 1 )
+        return(c);
+    else
+        return(-1);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Read everything available, never blocks                                  */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_readbuf( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    int n;
+
+    if( (n = read( MyComms->fd, data, data_len )) > 0 )
+        return(n);
+    else
+        return(0);
+}
+
+/*---------------------------------------------------------------------------*/
+/*  Write buffer to the uart, waits only if the driver buffer is full        */
+/*---------------------------------------------------------------------------*/
+
+static int
+serial_writebuf( p3comms *MyComms, unsigned char *data, int data_len )
+{
+    struct pollfd   pfd;
+    int             n;
+
+    pfd.fd     = MyComms->fd;
+    pfd.events = POLLOUT;
+
+    while( data_len > 0 )
+        {
+        if( (n = write( MyComms->fd, data, data_len )) > 0 )
+            {
+            data     += n;
+            data_len -= n;
+            }
+        else
+        if( n < 0 && errno == EAGAIN )
+            poll( &pfd, 1, -1 );
+        else
+        if( n < 0 && errno == EINTR )
+            continue;
+        else
+            return(-1);
+        }
+
+    return(0);
+}
+
 #else
 /*---------------------------------------------------------------------------*/
 /*  PROS glue code                                                           */
@@ -252,6 +427,7 @@ P3Init( int port, p3mode mode, int debug_flag, long baud )
         MyComms->baud    = baud;
         MyComms->mode    = mode;
         MyComms->state   = kP3StateIdle;
+        MyComms->step    = 1;
 
         MyComms->debug   = debug_flag;
 
@@ -267,6 +443,21 @@ P3Init( int port, p3mode mode, int debug_flag, long baud )
         for(i=0;i<SERIAL_NUMBER_STRING_LEN;i++)
             MyComms->serial_number[i] = 0;
 
+        // each submit slot starts free for its own position
+        for(i=0;i<P3_SUBMIT_QUEUE_SIZE;i++)
+            MyComms->submit[i].seq = i;
+
+        // slaves accept any address and are in every group until told otherwise
+        MyComms->address   = P3_ADDRESS_ANY;
+        MyComms->groupMask = P3_GROUP_ALL;
+
+        // no devices known yet
+        for(i=0;i<P3_MAX_DEVICES;i++)
+            {
+            MyComms->device[i].timeout = P3_REPLY_TIMEOUT;
+            MyComms->device[i].identity.dev_id = -1;
+            }
+
 #ifdef  _TARGET_CONVEX_
         // Generally avoid SD1, use SD2 or SD3
         if( port == 0 )
@@ -276,6 +467,18 @@ P3Init( int port, p3mode mode, int debug_flag, long baud )
             MyComms->sdp = &SD2;
         else
             MyComms->sdp = &SD3;
+#elif defined(_TARGET_LINUX_)
+        // negative port for no device, see P3Open
+        if( port < 0 )
+            MyComms->sdp = NULL;
+        else
+        if( port == 0 )
+            MyComms->sdp = "/dev/ttyS0";
+        else
+        if( port == 1 )
+            MyComms->sdp = "/dev/ttyUSB0";
+        else
+            MyComms->sdp = "/dev/ttyUSB1";
 #else
         if( port == 0 )
             MyComms->sdp = stdout;
@@ -293,6 +496,11 @@ P3Init( int port, p3mode mode, int debug_flag, long baud )
         MyComms->write_buf  = serial_writebuf;
         MyComms->peek_input = serial_peekinput;
         MyComms->get_byte   = serial_getchar;
+        MyComms->read_buf   = NULL;
+#ifdef  _TARGET_LINUX_
+        MyComms->deinit     = serial_deinit;
+        MyComms->read_buf   = serial_readbuf;
+#endif
 
         // Init the serial port here
         P3InitSerial( MyComms );
@@ -301,6 +509,51 @@ P3Init( int port, p3mode mode, int debug_flag, long baud )
     return( MyComms );
 }
 
+#ifdef  _TARGET_LINUX_
+/*---------------------------------------------------------------------------*/
+/*      Open P3 communications on a named serial device                      */
+/*---------------------------------------------------------------------------*/
+
+p3comms *
+P3Open( char *device, p3mode mode, int debug_flag, long baud )
+{
+    p3comms *MyComms;
+
+    if( (MyComms = P3Init( -1, mode, debug_flag, baud )) == NULL )
+        return( NULL );
+
+    MyComms->sdp = device;
+    P3InitSerial( MyComms );
+
+    if( MyComms->fd < 0 )
+        {
+        P3Deinit( MyComms );
+        return( NULL );
+        }
+
+    return( MyComms );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Open P3 communications on an fd that is already open, a pipe or a    */
+/*      pty for testing.  The fd is closed by P3Deinit                       */
+/*---------------------------------------------------------------------------*/
+
+p3comms *
+P3OpenFd( int fd, p3mode mode, int debug_flag )
+{
+    p3comms *MyComms;
+
+    if( (MyComms = P3Init( -1, mode, debug_flag, 0 )) == NULL )
+        return( NULL );
+
+    MyComms->fd = fd;
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+
+    return( MyComms );
+}
+#endif
+
 /*---------------------------------------------------------------------------*/
 /*      Close the P3 communications                                          */
 /*---------------------------------------------------------------------------*/
@@ -322,6 +575,80 @@ P3Deinit(p3comms *MyComms)
         }
 }
 
+/*---------------------------------------------------------------------------*/
+/*      Closed link - finish every request waiting in the submit queue,      */
+/*      called by P3Close and by any task that submits after it              */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3DrainClosed( p3comms *MyComms )
+{
+    p3submit        *slot;
+    unsigned int    tail;
+    void            (*complete)( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context );
+    void            *context;
+
+    for(;;)
+        {
+        tail = MyComms->submitTail;
+        slot = &MyComms->submit[ tail & (P3_SUBMIT_QUEUE_SIZE-1) ];
+
+        // empty, or the task still writing it will drain when it is done
+        if( slot->seq != (tail + 1) )
+            return;
+
+        P3_MEMORY_BARRIER();
+        complete = slot->complete;
+        context  = slot->context;
+
+        // more than one task may drain at once
+        if( !__sync_bool_compare_and_swap( &MyComms->submitTail, tail, tail + 1 ) )
+            continue;
+
+        P3_MEMORY_BARRIER();
+        slot->seq = tail + P3_SUBMIT_QUEUE_SIZE;
+
+        if( complete != NULL )
+            complete( MyComms, NULL, kP3ReqClosed, context );
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Link has gone, called by the comms task.  Every request waiting,     */
+/*      sent or scheduled finishes with kP3ReqClosed and new requests are    */
+/*      refused.  Other tasks may still hold the pointer so nothing is       */
+/*      freed, P3Deinit does that once they are done with it.                */
+/*---------------------------------------------------------------------------*/
+
+void
+P3Close( p3comms *MyComms )
+{
+    p3slot  *slot;
+    int     i;
+
+    if( MyComms->closed )
+        return;
+
+    MyComms->closed = 1;
+    P3_MEMORY_BARRIER();
+
+    // close the port, once
+    if( MyComms->deinit != NULL )
+        MyComms->deinit( MyComms );
+    MyComms->deinit = NULL;
+
+    P3CompleteRequest( MyComms, NULL, kP3ReqClosed );
+    P3DrainClosed( MyComms );
+
+    // each slot user hears once
+    for(i=0;i<MyComms->slotCount;i++)
+        {
+        slot = &MyComms->slot[i];
+        if( slot->complete != NULL )
+            slot->complete( MyComms, NULL, kP3ReqClosed, slot->context );
+        }
+}
+
 /*---------------------------------------------------------------------------*/
 /*      Initialize serial port                                               */
 /*---------------------------------------------------------------------------*/
@@ -345,6 +672,30 @@ P3SetReplyDecoder( p3comms *MyComms, void *callback )
     MyComms->packet_decode = callback;
 }
 
+/*---------------------------------------------------------------------------*/
+/*      Utility - set a callback made when another task submits work, for    */
+/*      comms tasks that sleep until there is something to do                */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetWake( p3comms *MyComms, void *callback, void *context )
+{
+    MyComms->wakeContext = context;
+    MyComms->wake        = callback;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Utility - set a callback made for every good frame received, after   */
+/*      it has been decoded, for logging                                     */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetMonitor( p3comms *MyComms, void *callback, void *context )
+{
+    MyComms->monitorContext = context;
+    MyComms->monitor        = callback;
+}
+
 /*---------------------------------------------------------------------------*/
 /*      Utility - set manufacturer without using string functions            */
 /*---------------------------------------------------------------------------*/
@@ -421,33 +772,28 @@ P3SetHardwareVersion( p3comms *MyComms, unsigned char major, unsigned char minor
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Take P3 command and place into tx packet                             */
+/*      Encode P3 command into a frame, returns the frame length             */
 /*---------------------------------------------------------------------------*/
 
 int
-P3Command( p3comms *MyComms, void *command, int dest_id )
+P3EncodeFrame( unsigned char *frame, void *command, int dest_id )
 {
     unsigned int     i;
     unsigned char   *p, *q;
-    p3pak           *MyPak;
+    unsigned char    chk_sum;
     p3cmdfull       *MyCmd = (p3cmdfull *)command;
 
-    MyPak = &MyComms->TxPak;
-
-    // Get command length, add 6 bytes for overhead
-    MyPak->cmd_len = (MyCmd->length) + 6;
-
     // Create header
-    MyPak->command.data[0] = P3_PREAMBLE1;
-    MyPak->command.data[1] = P3_PREAMBLE2;
-    MyPak->command.data[2] = (MyCmd->cmd1 << 4) + (dest_id & 0x0F);
-    MyPak->command.data[3] = MyCmd->cmd2;
-    MyPak->command.data[4] = MyCmd->length;
+    frame[0] = P3_PREAMBLE1;
+    frame[1] = P3_PREAMBLE2;
+    frame[2] = (MyCmd->cmd1 << 4) + (dest_id & 0x0F);
+    frame[3] = MyCmd->cmd2;
+    frame[4] = MyCmd->length;
 
     // Start of checksum
-    q = &MyPak->command.data[0];
-    for(i=0,MyPak->chk_sum = 0;i<5;i++)
-        MyPak->chk_sum ^= *q++;
+    q = &frame[0];
+    for(i=0,chk_sum = 0;i<5;i++)
+        chk_sum ^= *q++;
 
     // move any data that exists
     if( MyCmd->length > 0 )
@@ -455,13 +801,51 @@ P3Command( p3comms *MyComms, void *command, int dest_id )
         p = &MyCmd->data[0];
         for(i=0;i<MyCmd->length;i++)
             {
-            MyPak->chk_sum ^= *p;
+            chk_sum ^= *p;
             *q++ = *p++;
             }
         }
 
     // put checksum into packet
-    *q++ = MyPak->chk_sum;
+    *q++ = chk_sum;
+
+    // command length plus 6 bytes for overhead
+    return( MyCmd->length + 6 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Take P3 command and place into tx packet                             */
+/*      This changes link state so is only called from the comms task,       */
+/*      other tasks use P3Submit                                             */
+/*---------------------------------------------------------------------------*/
+
+int
+P3Command( p3comms *MyComms, void *command, int dest_id )
+{
+    p3pak           *MyPak;
+
+    // master waiting for a reply holds the packet until the reply arrives
+    if( (MyComms->mode == kP3ModeMaster) && (MyComms->state == kP3StateReplyWait) )
+        MyPak = &MyComms->ExPak;
+    else
+        MyPak = &MyComms->TxPak;
+
+    MyPak->cmd_len = P3EncodeFrame( MyPak->command.data, command, dest_id );
+
+    // slave piggybacks the application heartbeat on ACK replies
+    if( (MyComms->mode == kP3ModeSlave) && MyComms->heartbeat &&
+        (MyPak->command.data[2] >> 4) == CMD1_GROUP_SYSTEM_REPLY &&
+         MyPak->command.data[3] == CMD2_SYSTEM_ACK && MyPak->cmd_len > 6 )
+        {
+        MyComms->heartbeat = 0;
+        if( (MyPak->command.data[5] & P3_ACK_HEARTBEAT) == 0 )
+            {
+            MyPak->command.data[5] |= P3_ACK_HEARTBEAT;
+            MyPak->command.data[ MyPak->cmd_len - 1 ] ^= P3_ACK_HEARTBEAT;
+            }
+        }
+
+    MyPak->chk_sum = MyPak->command.data[ MyPak->cmd_len - 1 ];
 
     // Send packet
     if(MyComms->mode == kP3ModeMaster)
@@ -470,7 +854,11 @@ P3Command( p3comms *MyComms, void *command, int dest_id )
             {
             P3SendPacket( MyComms, MyPak );
 
-            MyComms->state = kP3StateReplyWait;
+            // nothing answers a broadcast
+            if( (dest_id & 0x0F) == GLOBAL_DEVICE_ID )
+                MyComms->state = kP3StateIdle;
+            else
+                MyComms->state = kP3StateReplyWait;
             }
         else
             {
@@ -484,378 +872,1827 @@ P3Command( p3comms *MyComms, void *command, int dest_id )
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Print a packet for debug purposes                                    */
+/*      Call the completion for the outstanding request                      */
 /*---------------------------------------------------------------------------*/
 
-void
-P3DebugPacket( p3pak *packet )
+static void
+P3CompleteRequest( p3comms *MyComms, p3pak *reply, p3reqstatus status )
 {
-    unsigned char   *p;
-    int             i;
+    void    (*complete)( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context );
 
-    p = &packet->command.data[0];
-#ifdef  _TARGET_CONVEX_
-    for(i=0;i<packet->cmd_len;i++)
-        vex_printf("%02X ",*p++);
-    vex_printf("\r\n");
-#else
-    for(i=0;i<packet->cmd_len;i++)
-        printf("%02X ",*p++);
-    printf("\r\n");
-#endif
-    return;
+    if( (complete = MyComms->complete) == NULL )
+        return;
+
+    // clear first as the callback may submit another request
+    MyComms->complete = NULL;
+    complete( MyComms, reply, status, MyComms->completeContext );
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Take P3 packet and start transmission                                */
+/*      Submit a P3 command from any task                                    */
+/*      Producers claim a slot by moving submitHead with compare and swap,   */
+/*      a slot is free when its seq equals the position being claimed and    */
+/*      is ready to send when seq is one more.  No locks are taken.          */
 /*---------------------------------------------------------------------------*/
 
 int
-P3SendPacket( p3comms *MyComms, p3pak *packet )
+P3Submit( p3comms *MyComms, void *command, int dest_id )
 {
-    // If master set timeout to 10mS
-    if(MyComms->mode == kP3ModeMaster)
-        MyComms->rxto = 5;
-
-    // Debug
-    if(MyComms->DebugTx)
-        P3DebugPacket( packet );
-
-    // Transmit
-    MyComms->write_buf( MyComms, packet->command.data, packet->cmd_len );
-
-    return( P3_SUCCESS );
+    return( P3Request( MyComms, command, dest_id, NULL, NULL ) );
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Check for serial port for some data                                  */
+/*      Submit a P3 request from any task, master only                       */
+/*      callback is called by the comms task when the request finishes as    */
+/*      void callback( p3comms *MyComms, p3pak *reply, p3reqstatus status,   */
+/*                     void *context )                                       */
+/*      reply is NULL for a timeout or a corrupt reply, a broadcast to       */
+/*      GLOBAL_DEVICE_ID completes with kP3ReqReply and NULL once sent       */
 /*---------------------------------------------------------------------------*/
 
 int
-P3ReceiveData(p3comms *MyComms)
+P3Request( p3comms *MyComms, void *command, int dest_id, void *callback, void *context )
 {
-    int         data;
+    p3cmdfull       *MyCmd = (p3cmdfull *)command;
+    p3submit        *slot;
+    unsigned int    pos;
+    int             dif;
 
-    // No data then return immeadiately
-    if( MyComms->peek_input(MyComms) < 0 )
-        {
-        if( MyComms->rxto > 0 )
-            {
-            MyComms->rxto--;
+    if( (MyCmd->length > P3_SMALL_MSG) || MyComms->closed )
+        return( P3_FAILURE );
 
-            // Interbyte timeout
-            if( MyComms->rxto == 0 )
-                {
-                MyComms->RxPak.cmd_cnt = 0;
-                MyComms->state = kP3StateTimeout;
-                MyComms->tcount++;
+    pos = MyComms->submitHead;
+    for(;;)
+        {
+        slot = &MyComms->submit[ pos & (P3_SUBMIT_QUEUE_SIZE-1) ];
+        dif  = (int)(slot->seq - pos);
 
-                // if slave then send timeout NAK
-                if( MyComms->mode == kP3ModeSlave )
-                    P3Command(MyComms, &Cmd_Nak_Timeout , GLOBAL_DEVICE_ID );
-                }
+        if( dif == 0 )
+            {
+            // free, try and claim it
+            if( __sync_bool_compare_and_swap( &MyComms->submitHead, pos, pos + 1 ) )
+                break;
+            }
+        else
+        if( dif < 0 )
+            {
+            // full
+            return( P3_FAILURE );
             }
 
-        return( P3_RX_NO_DATA );
+        // another task got there first
+        pos = MyComms->submitHead;
         }
 
-    // At least one byte available
-    MyComms->rxcnt = 0;
+    memcpy( &slot->cmd, MyCmd, MyCmd->length + 3 );
+    slot->dest_id  = dest_id;
+    slot->complete = callback;
+    slot->context  = context;
+
+    // command must be complete before the comms task can see it
+    P3_MEMORY_BARRIER();
+    slot->seq = pos + 1;
 
-    // Read everything available
-    do
+    // link closed while this was being written, no comms task will send it
+    P3_MEMORY_BARRIER();
+    if( MyComms->closed )
         {
-        data = MyComms->get_byte(MyComms);
-        if( data >= 0 )
-            {
-            MyComms->rxbuf[MyComms->rxcnt++] = data;
-            if( MyComms->rxcnt == P3_RX_BUF_SIZE )
-                {
-                return( P3_RX_BUF_ERR );
-                }
-            }
-        } while( data >= 0 );
+        P3DrainClosed( MyComms );
+        return( P3_SUCCESS );
+        }
 
-    // timeout set to 5 calls, usually 10mS
-    MyComms->rxto = 5;
+    if( MyComms->wake != NULL )
+        MyComms->wake( MyComms, MyComms->wakeContext );
 
-    return( MyComms->rxcnt );
- }
+    return( P3_SUCCESS );
+}
 
 /*---------------------------------------------------------------------------*/
-/*      Received some data so start to decode packet                         */
+/*      Transact - the waiting task and the comms task share this, it is     */
+/*      freed by whichever lets go last as a caller that times out may       */
+/*      return before the comms task completes the request                   */
+/*---------------------------------------------------------------------------*/
+
+#define P3_WAITER_WAITING   0
+#define P3_WAITER_DONE      1           // comms task has the result
+#define P3_WAITER_GONE      2           // caller timed out
+
+typedef struct _p3waiter {
+#ifdef  _TARGET_CONVEX_
+    BinarySemaphore sem;
+#elif defined(_TARGET_LINUX_)
+    sem_t           sem;
+#else
+    Semaphore       sem;
+#endif
+    volatile int    state;
+    volatile int    refs;
+    p3reqstatus     status;
+    p3cmdfull      *reply;
+    } p3waiter;
+
+static void
+P3WaiterRelease( p3waiter *waiter )
+{
+    if( __sync_sub_and_fetch( &waiter->refs, 1 ) != 0 )
+        return;
+
+#ifdef  _TARGET_CONVEX_
+    chHeapFree( waiter );
+#elif defined(_TARGET_LINUX_)
+    sem_destroy( &waiter->sem );
+    free( waiter );
+#else
+    semaphoreDelete( waiter->sem );
+    free( waiter );
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Transact - completion, copy the reply and wake the waiting task      */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3TransactDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
+{
+    p3waiter    *waiter = (p3waiter *)context;
+
+    (void)MyComms;
+
+    // caller still waiting, the reply buffer is still there
+    if( __sync_bool_compare_and_swap( &waiter->state, P3_WAITER_WAITING, P3_WAITER_DONE ) )
+        {
+        waiter->status = status;
+        if( (reply != NULL) && (waiter->reply != NULL) )
+            memcpy( waiter->reply, &reply->command.cmdpak.cmd, reply->command.cmdpak.cmd.length + 3 );
+
+#ifdef  _TARGET_CONVEX_
+        chBSemSignal( &waiter->sem );
+#elif defined(_TARGET_LINUX_)
+        sem_post( &waiter->sem );
+#else
+        semaphoreGive( waiter->sem );
+#endif
+        }
+
+    P3WaiterRelease( waiter );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Transact - send a request and wait for it to finish                  */
+/*      The calling task sleeps until the comms task has decoded the reply   */
+/*      or timed out, so a sequence of requests runs at the speed of the     */
+/*      link rather than at a fixed polling rate.  reply may be NULL.        */
+/*      timeout in mS bounds the wait in case the comms task has stopped.    */
+/*      Returns the p3reqstatus or P3_FAILURE if it could not be sent.       */
+/*---------------------------------------------------------------------------*/
+
+int
+P3Transact( p3comms *MyComms, void *command, int dest_id, p3cmdfull *reply, int timeout )
+{
+    p3waiter    *waiter;
+    int         ret;
+    int         done;
+#ifdef  _TARGET_LINUX_
+    struct timespec ts;
+#endif
+
+#ifdef  _TARGET_CONVEX_
+    waiter = (p3waiter *)chHeapAlloc( NULL, sizeof(p3waiter) );
+#else
+    waiter = (p3waiter *)malloc( sizeof(p3waiter) );
+#endif
+    if( waiter == NULL )
+        return( P3_FAILURE );
+
+    waiter->state  = P3_WAITER_WAITING;
+    waiter->refs   = 2;
+    waiter->status = kP3ReqTimeout;
+    waiter->reply  = reply;
+
+#ifdef  _TARGET_CONVEX_
+    chBSemInit( &waiter->sem, TRUE );
+#elif defined(_TARGET_LINUX_)
+    if( sem_init( &waiter->sem, 0, 0 ) < 0 )
+        {
+        free( waiter );
+        return( P3_FAILURE );
+        }
+#else
+    if( (waiter->sem = semaphoreCreate()) == NULL )
+        {
+        free( waiter );
+        return( P3_FAILURE );
+        }
+    // make sure we start with it taken
+    semaphoreTake( waiter->sem, 0 );
+#endif
+
+    ret = P3Request( MyComms, command, dest_id, P3TransactDone, waiter );
+    if( ret != P3_SUCCESS )
+        {
+        // the comms task never saw it
+        waiter->refs = 1;
+        P3WaiterRelease( waiter );
+        return( ret );
+        }
+
+#ifdef  _TARGET_CONVEX_
+    done = (chBSemWaitTimeout( &waiter->sem, MS2ST(timeout) ) == RDY_OK);
+#elif defined(_TARGET_LINUX_)
+    clock_gettime( CLOCK_REALTIME, &ts );
+    ts.tv_sec  += timeout / 1000;
+    ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if( ts.tv_nsec >= 1000000000L )
+        {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+        }
+    while( (done = (sem_timedwait( &waiter->sem, &ts ) == 0)) == 0 && errno == EINTR )
+        ;
+#else
+    done = semaphoreTake( waiter->sem, timeout );
+#endif
+
+    // leave the request to the comms task, unless it finished just now
+    // in which case the wake is on its way
+    if( !done && !__sync_bool_compare_and_swap( &waiter->state, P3_WAITER_WAITING, P3_WAITER_GONE ) )
+        {
+#ifdef  _TARGET_CONVEX_
+        chBSemWait( &waiter->sem );
+#elif defined(_TARGET_LINUX_)
+        while( sem_wait( &waiter->sem ) < 0 && errno == EINTR )
+            ;
+#else
+        semaphoreTake( waiter->sem, MAX_DELAY );
+#endif
+        }
+
+    ret = waiter->status;
+    P3WaiterRelease( waiter );
+
+    return( ret );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Schedule - add a command sent to dest_id every period calls to       */
+/*      P3CommsTask.  reply_len is the expected reply data length, used      */
+/*      with the command length and baud rate to work out how much of the    */
+/*      link the slot needs.  Call at init, fails if the schedule would      */
+/*      use more than P3_SCHEDULE_MAX_LOAD.  Returns the slot index.         */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ScheduleAdd( p3comms *MyComms, int dest_id, p3cmd *cmd, int reply_len, int period, void *callback, void *context )
+{
+    p3slot          *slot;
+    unsigned long   bits, wire_us;
+    int             load;
+
+    if( (MyComms->slotCount >= P3_MAX_SLOTS) || (period <= 0) || (MyComms->baud <= 0) )
+        return( P3_FAILURE );
+
+    // command and reply frames, a transaction also takes at least one
+    // call to the comms task
+    bits    = ((cmd->length + 6) + (reply_len + 6)) * P3_BITS_PER_BYTE;
+    wire_us = (bits * 1000000UL + MyComms->baud - 1) / MyComms->baud;
+    if( wire_us < P3_TICK_US )
+        wire_us = P3_TICK_US;
+
+    load = (wire_us * 1000UL + (unsigned long)period * P3_TICK_US - 1) / ((unsigned long)period * P3_TICK_US);
+
+    // admission, the wire cannot carry this schedule
+    if( MyComms->scheduleLoad + load > P3_SCHEDULE_MAX_LOAD )
+        return( P3_FAILURE );
+
+    slot = &MyComms->slot[ MyComms->slotCount ];
+    slot->dest_id  = dest_id;
+    slot->cmd      = cmd;
+    slot->period   = period;
+    slot->load     = load;
+    slot->priority = 0;
+    slot->due      = MyComms->ticks;
+    slot->freshValid = 0;
+    slot->sent     = 0;
+    slot->skipped  = 0;
+    slot->misses   = 0;
+    slot->complete = (void (*)(p3comms *, p3pak *, p3reqstatus, void *))callback;
+    slot->context  = context;
+
+    MyComms->scheduleLoad += load;
+
+    return( MyComms->slotCount++ );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Schedule - link load in parts per thousand                           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ScheduleLoad( p3comms *MyComms )
+{
+    return( MyComms->scheduleLoad );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Schedule - set slot priority, used when deadlines are equal          */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SchedulePriority( p3comms *MyComms, int index, int priority )
+{
+    if( (index >= 0) && (index < MyComms->slotCount) )
+        MyComms->slot[index].priority = priority;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Schedule - the slave has pushed the value this slot polls for,       */
+/*      the slot is skipped until the value is a period old, for example     */
+/*      call when a mirror update arrives                                    */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ScheduleFresh( p3comms *MyComms, int index )
+{
+    if( (index >= 0) && (index < MyComms->slotCount) )
+        {
+        MyComms->slot[index].fresh      = MyComms->ticks;
+        MyComms->slot[index].freshValid = 1;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Schedule - send the due slot with the earliest deadline              */
+/*      returns 1 if a command was sent                                      */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3SendScheduled( p3comms *MyComms )
+{
+    p3slot          *slot, *next = NULL;
+    p3device        *dev;
+    long            late, diff;
+    int             i;
+
+    for(i=0;i<MyComms->slotCount;i++)
+        {
+        slot = &MyComms->slot[i];
+        if( (long)(MyComms->ticks - slot->due) < 0 )
+            continue;
+
+        // value pushed recently, leave the link for others
+        if( slot->freshValid && (long)(MyComms->ticks - slot->fresh) < slot->period )
+            {
+            slot->due += slot->period;
+            slot->skipped++;
+            continue;
+            }
+
+        if( next == NULL )
+            {
+            next = slot;
+            continue;
+            }
+
+        diff = (long)((slot->due + slot->period) - (next->due + next->period));
+        if( (diff < 0) || ((diff == 0) && (slot->priority > next->priority)) )
+            next = slot;
+        }
+
+    if( (slot = next) == NULL )
+        return( 0 );
+
+    // periods we could not send in are deadline misses, releases stay
+    // on the original phase
+    late = MyComms->ticks - slot->due;
+    if( late >= slot->period )
+        {
+        slot->misses += late / slot->period;
+        slot->due    += (late / slot->period) * slot->period;
+        }
+    slot->due += slot->period;
+
+    MyComms->complete        = slot->complete;
+    MyComms->completeContext = slot->context;
+    MyComms->completeId      = slot->dest_id & 0x0F;
+
+    // nothing to gain from a device known to be absent, the slot user
+    // still sees the miss as a timeout
+    dev = P3GetDevice( MyComms, slot->dest_id );
+    if( (dev != NULL) && (dev->probeQuiet > 0) && (dev->online == 0) )
+        {
+        P3CompleteRequest( MyComms, NULL, kP3ReqTimeout );
+        return( 0 );
+        }
+
+    P3Command( MyComms, slot->cmd, slot->dest_id );
+    slot->sent++;
+
+    if( MyComms->completeId == GLOBAL_DEVICE_ID )
+        P3CompleteRequest( MyComms, NULL, kP3ReqReply );
+
+    return( 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Print schedule statistics for debug purposes                         */
+/*---------------------------------------------------------------------------*/
+
+void
+P3DebugSchedule( p3comms *MyComms )
+{
+    p3slot  *slot;
+    int     i;
+
+    for(i=0;i<MyComms->slotCount;i++)
+        {
+        slot = &MyComms->slot[i];
+#ifdef  _TARGET_CONVEX_
+        vex_printf("slot %d id %d period %d load %d sent %d skipped %d misses %d\r\n",
+                    i, slot->dest_id, slot->period, slot->load, (int)slot->sent, (int)slot->skipped, (int)slot->misses );
+#else
+        printf("slot %d id %d period %d load %d sent %d skipped %d misses %d\r\n",
+                i, slot->dest_id, slot->period, slot->load, (int)slot->sent, (int)slot->skipped, (int)slot->misses );
+#endif
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Stage a command on one slave from any task, it is applied when a     */
+/*      commit for one of the slave's groups arrives                         */
+/*---------------------------------------------------------------------------*/
+
+int
+P3Stage( p3comms *MyComms, void *command, int dest_id )
+{
+    p3cmdfull   *MyCmd = (p3cmdfull *)command;
+    p3cmd        stage;
+
+    // wrapped command must fit in a small message
+    if( MyCmd->length + 3 > P3_SMALL_MSG )
+        return( P3_FAILURE );
+
+    stage.cmd1   = CMD1_GROUP_SYSTEM_CMD;
+    stage.cmd2   = CMD2_SYSTEM_STAGE;
+    stage.length = MyCmd->length + 3;
+    memcpy( stage.data, MyCmd, MyCmd->length + 3 );
+
+    return( P3Submit( MyComms, &stage, dest_id ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Broadcast a commit from any task, every slave in one of the groups   */
+/*      applies its staged command at the same time                          */
+/*---------------------------------------------------------------------------*/
+
+int
+P3Commit( p3comms *MyComms, int groups )
+{
+    p3cmd        commit;
+
+    commit.cmd1    = CMD1_GROUP_SYSTEM_CMD;
+    commit.cmd2    = CMD2_SYSTEM_COMMIT;
+    commit.length  = 1;
+    commit.data[0] = groups;
+
+    return( P3Submit( MyComms, &commit, GLOBAL_DEVICE_ID ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Slave - set our dev_id, frames for other devices are skipped as      */
+/*      they arrive.  P3_ADDRESS_ANY accepts everything                      */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetAddress( p3comms *MyComms, int address )
+{
+    MyComms->address = (address == P3_ADDRESS_ANY) ? P3_ADDRESS_ANY : (address & 0x0F);
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Slave - set the groups this slave commits for                        */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetGroups( p3comms *MyComms, int groups )
+{
+    MyComms->groupMask = groups;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Route frames for dev_id received on this port to another port, NULL  */
+/*      to decode them here.  Frames are sent on as they arrive so the       */
+/*      other port should not send its own commands while routing            */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetRoute( p3comms *MyComms, int dev_id, p3comms *to )
+{
+    MyComms->route[ dev_id & 0x0F ] = to;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Send the next submitted command, comms task only                     */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SendPending( p3comms *MyComms )
+{
+    p3submit        *slot;
+    p3device        *dev;
+    unsigned int    tail = MyComms->submitTail;
+    int             dest_id;
+    int             absent;
+    int             i;
+
+    // master has one command outstanding at a time
+    if( (MyComms->mode == kP3ModeMaster) && (MyComms->state != kP3StateIdle) )
+        return;
+
+    // a request still open when idle had a reply from the wrong device
+    P3CompleteRequest( MyComms, NULL, kP3ReqTimeout );
+    MyComms->MirrorWait = 0;
+
+    // scheduled slots go before anything else
+    if( (MyComms->mode == kP3ModeMaster) && P3SendScheduled( MyComms ) )
+        return;
+
+    slot = &MyComms->submit[ tail & (P3_SUBMIT_QUEUE_SIZE-1) ];
+    if( slot->seq == (tail + 1) )
+        {
+        P3_MEMORY_BARRIER();
+
+        // a device we probe and know is absent would only waste the
+        // bus waiting for a timeout, fail the request straight away
+        dev = P3GetDevice( MyComms, slot->dest_id );
+        absent = (MyComms->mode == kP3ModeMaster) && (dev != NULL) &&
+                 (dev->probeQuiet > 0) && (dev->online == 0);
+
+        if( !absent )
+            P3Command( MyComms, &slot->cmd, slot->dest_id );
+
+        MyComms->complete        = slot->complete;
+        MyComms->completeContext = slot->context;
+        MyComms->completeId      = slot->dest_id & 0x0F;
+
+        // slot is free for the producer one lap later
+        P3_MEMORY_BARRIER();
+        slot->seq = tail + P3_SUBMIT_QUEUE_SIZE;
+        MyComms->submitTail = tail + 1;
+
+        if( absent )
+            P3CompleteRequest( MyComms, NULL, kP3ReqTimeout );
+        else
+        if( (slot->dest_id & 0x0F) == GLOBAL_DEVICE_ID )
+            P3CompleteRequest( MyComms, NULL, kP3ReqReply );
+        return;
+        }
+
+    // nothing submitted, send a mirror sync if asked for
+    if( (dest_id = MyComms->MirrorSyncId) > 0 )
+        {
+        MyComms->MirrorSyncId = 0;
+
+        P3MirrorEncode( &MyComms->MirrorTx, &Cmd_Mirror_Sync );
+
+        // let the slave know if we saw its last reply
+        Cmd_Mirror_Sync.data[0] = MyComms->MirrorAck ? P3_MIRROR_FLAG_ACK : 0;
+        MyComms->MirrorAck = 0;
+
+        P3Command( MyComms, &Cmd_Mirror_Sync, dest_id - 1 );
+
+        // no completion, only a NAK is looked for
+        MyComms->MirrorWait = 1;
+        MyComms->completeId = (dest_id - 1) & 0x0F;
+        return;
+        }
+
+    if( MyComms->mode == kP3ModeSlave )
+        return;
+
+    // probe the next device that has been quiet, round robin so
+    // every device gets a turn
+    for(i=0;i<P3_MAX_DEVICES;i++)
+        {
+        dest_id = (MyComms->probeNext + i) % P3_MAX_DEVICES;
+        dev     = &MyComms->device[dest_id];
+
+        if( (dev->probeQuiet > 0) &&
+            (long)(MyComms->ticks - dev->lastRx) >= dev->probeQuiet &&
+            (long)(MyComms->ticks - dev->probeAt) >= 0 )
+            {
+            P3Command( MyComms, &Cmd_Probe, dest_id );
+            MyComms->probeNext = (dest_id + 1) % P3_MAX_DEVICES;
+
+            // back off while the device is absent
+            dev->probeAt = MyComms->ticks + dev->probeInterval;
+            if( dev->online == 0 )
+                {
+                dev->probeInterval *= 2;
+                if( dev->probeInterval > P3_PROBE_INTERVAL_MAX )
+                    dev->probeInterval = P3_PROBE_INTERVAL_MAX;
+                }
+            return;
+            }
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Print a packet for debug purposes                                    */
+/*---------------------------------------------------------------------------*/
+
+void
+P3DebugPacket( p3pak *packet )
+{
+    unsigned char   *p;
+    int             i;
+
+    p = &packet->command.data[0];
+#ifdef  _TARGET_CONVEX_
+    for(i=0;i<packet->cmd_len;i++)
+        vex_printf("%02X ",*p++);
+    vex_printf("\r\n");
+#else
+    for(i=0;i<packet->cmd_len;i++)
+        printf("%02X ",*p++);
+    printf("\r\n");
+#endif
+    return;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Take P3 packet and start transmission                                */
+/*---------------------------------------------------------------------------*/
+
+int
+P3SendPacket( p3comms *MyComms, p3pak *packet )
+{
+    p3device    *dev;
+
+    // Slave answering a broadcast, drop it
+    if( MyComms->noReply )
+        return( P3_SUCCESS );
+
+    // If master set timeout for the device, usually 10mS, no reply
+    // is expected for a broadcast
+    if(MyComms->mode == kP3ModeMaster)
+        {
+        MyComms->waitId = packet->command.data[2] & 0x0F;
+        if( (dev = P3GetDevice( MyComms, MyComms->waitId )) != NULL )
+            MyComms->rxto = dev->timeout;
+        }
+
+    // Debug
+    if(MyComms->DebugTx)
+        P3DebugPacket( packet );
+
+    // Transmit
+    MyComms->write_buf( MyComms, packet->command.data, packet->cmd_len );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Check for serial port for some data                                  */
+/*---------------------------------------------------------------------------*/
+
+int
+P3ReceiveData(p3comms *MyComms)
+{
+    int         data;
+
+    // Drivers that can read everything available in one call
+    if( MyComms->read_buf != NULL )
+        {
+        MyComms->rxcnt = MyComms->read_buf( MyComms, MyComms->rxbuf, P3_RX_BUF_SIZE );
+        if( MyComms->rxcnt > 0 )
+            {
+            // timeout set to 5 calls, usually 10mS
+            MyComms->rxto = 5;
+            return( MyComms->rxcnt );
+            }
+        }
+    else
+    if( MyComms->peek_input(MyComms) >= 0 )
+        {
+        // At least one byte available
+        MyComms->rxcnt = 0;
+
+        // Read everything available
+        do
+            {
+            data = MyComms->get_byte(MyComms);
+            if( data >= 0 )
+                {
+                MyComms->rxbuf[MyComms->rxcnt++] = data;
+                if( MyComms->rxcnt == P3_RX_BUF_SIZE )
+                    {
+                    return( P3_RX_BUF_ERR );
+                    }
+                }
+            } while( data >= 0 );
+
+        // timeout set to 5 calls, usually 10mS
+        MyComms->rxto = 5;
+
+        return( MyComms->rxcnt );
+        }
+
+    // No data then return immeadiately
+    if( MyComms->rxto > 0 )
+        {
+        MyComms->rxto -= MyComms->step;
+
+        // Interbyte timeout
+        if( MyComms->rxto <= 0 )
+            {
+            // if slave then send timeout NAK, unless the frame was for
+            // someone else or being forwarded to them
+            if( (MyComms->mode == kP3ModeSlave) && !MyComms->rxSkip && (MyComms->forward == NULL) )
+                P3Command(MyComms, &Cmd_Nak_Timeout , GLOBAL_DEVICE_ID );
+
+            MyComms->rxto = 0;
+            MyComms->RxPak.cmd_cnt = 0;
+            MyComms->forward = NULL;
+            MyComms->state = kP3StateTimeout;
+            MyComms->tcount++;
+            MyComms->rxSkip = 0;
+            }
+        }
+
+    return( P3_RX_NO_DATA );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Received some data so start to decode packet                         */
+/*---------------------------------------------------------------------------*/
+
+void
+P3ReceivePacket( p3comms *MyComms )
+{
+    int             i, n;
+    int             fwd = 0;
+    p3pak           *RxPak;
+    p3device        *dev;
+
+    RxPak = &MyComms->RxPak;
+
+    for(i=0;i<MyComms->rxcnt;i++)
+        {
+        switch( RxPak->cmd_cnt )
+            {
+            case    0: // should be preamble 1
+                if( MyComms->rxbuf[i] == P3_PREAMBLE1 )
+                    {
+                    // for debug
+                    RxPak->command.cmdpak.preamble1 = P3_PREAMBLE1;
+                    RxPak->cmd_cnt = 1;
+                    }
+                else
+                    RxPak->cmd_cnt = 0;
+                break;
+
+            case    1: // should be preamble 2
+                if( MyComms->rxbuf[i] == P3_PREAMBLE2 )
+                    {
+                    // for debug
+                    RxPak->command.cmdpak.preamble2 = P3_PREAMBLE2;
+                    RxPak->chk_sum = P3_PREAMBLE1 ^ P3_PREAMBLE2;
+                    RxPak->cmd_cnt = 2;
+                    }
+                else
+                    RxPak->cmd_cnt = 0;
+                break;
+
+            case    2:
+                RxPak->command.cmdpak.cmd.cmd1 = MyComms->rxbuf[i]; // don;t mask now
+                RxPak->dev_id  = MyComms->rxbuf[i] & 0x0F;
+                RxPak->masked_cmd1 = (MyComms->rxbuf[i] >> 4) & 0x0F;
+                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
+                RxPak->cmd_cnt++;
+
+                // routed elsewhere, cut through starting with the preamble
+                if( (MyComms->forward = MyComms->route[RxPak->dev_id]) != NULL )
+                    {
+                    MyComms->forward->write_buf( MyComms->forward, RxPak->command.data, 2 );
+                    fwd = i;
+                    }
+                else
+                // slave only looks at frames for its address and broadcasts
+                if( (MyComms->mode == kP3ModeSlave) && (MyComms->address != P3_ADDRESS_ANY) &&
+                    (RxPak->dev_id != MyComms->address) && (RxPak->dev_id != GLOBAL_DEVICE_ID) )
+                    MyComms->rxSkip = 1;
+                break;
+
+            case    3:
+                RxPak->command.cmdpak.cmd.cmd2 = MyComms->rxbuf[i];
+                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
+                RxPak->cmd_cnt++;
+                break;
+
+            case    4:
+                // longer than any frame we send, drop it and look for
+                // the next preamble
+                if( MyComms->rxbuf[i] > P3_FULL_MSG )
+                    {
+                    RxPak->cmd_cnt   = 0;
+                    MyComms->rxSkip  = 0;
+                    MyComms->forward = NULL;
+                    break;
+                    }
+                RxPak->command.cmdpak.cmd.length = MyComms->rxbuf[i];
+                RxPak->cmd_len = MyComms->rxbuf[i] + 6;
+                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
+                RxPak->cmd_cnt++;
+                break;
+
+
+            default:
+                if( MyComms->rxSkip )
+                    {
+                    // not ours, jump over the rest of the frame
+                    n = RxPak->cmd_len - RxPak->cmd_cnt;
+                    if( n > MyComms->rxcnt - i )
+                        n = MyComms->rxcnt - i;
+                    RxPak->cmd_cnt += n;
+                    i += n - 1;
+                    }
+                else
+                if( RxPak->cmd_cnt < (RxPak->cmd_len) )
+                    {
+                    RxPak->command.data[RxPak->cmd_cnt] = MyComms->rxbuf[i];
+                    RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
+                    RxPak->cmd_cnt++;
+                    }
+             }
+
+        // end of a frame for someone else
+        if( MyComms->rxSkip && (RxPak->cmd_cnt > 0) && (RxPak->cmd_cnt == RxPak->cmd_len) )
+            {
+            MyComms->rxSkip = 0;
+            MyComms->rxto   = 0;
+            RxPak->cmd_cnt  = 0;
+            continue;
+            }
+
+        // end of a routed frame, send the rest on and only decode here
+        // if it was a broadcast
+        if( (MyComms->forward != NULL) && (RxPak->cmd_cnt > 0) && (RxPak->cmd_cnt == RxPak->cmd_len) )
+            {
+            MyComms->forward->write_buf( MyComms->forward, &MyComms->rxbuf[fwd], i - fwd + 1 );
+            MyComms->forward = NULL;
+
+            if( RxPak->dev_id != GLOBAL_DEVICE_ID )
+                {
+                MyComms->rxto  = 0;
+                RxPak->cmd_cnt = 0;
+                continue;
+                }
+            }
+
+        // Look for packet end / 2-April-13 added test for cmd_cmd > 0
+        if( (RxPak->cmd_cnt > 0) && (RxPak->cmd_cnt == RxPak->cmd_len) )
+            {
+            if(MyComms->DebugRx)
+                P3DebugPacket( RxPak );
+
+            if( RxPak->chk_sum != 0 )
+                {
+                // 2-April-13, only nak if we are slave
+                // checksum error
+                if( MyComms->mode == kP3ModeSlave )
+                    P3Command(MyComms, &Cmd_Nak_Chksum , RxPak->dev_id );
+                }
+            else
+                {
+                // slaves never answer a broadcast, the replies would collide
+                MyComms->noReply = (MyComms->mode == kP3ModeSlave) && (RxPak->dev_id == GLOBAL_DEVICE_ID);
+                P3DecodePacket( MyComms, &MyComms->RxPak );
+                MyComms->noReply = 0;
+
+                if( MyComms->monitor != NULL )
+                    MyComms->monitor( MyComms, RxPak, MyComms->monitorContext );
+                }
+
+            // clear timeout
+            MyComms->rxto   = 0;
+            RxPak->cmd_cnt  = 0;
+
+            // any valid frame shows the slave is online - used in master mode only
+            if( RxPak->chk_sum == 0 )
+                {
+                MyComms->online = 2;
+
+                if( (MyComms->mode == kP3ModeMaster) && ((dev = P3GetDevice( MyComms, RxPak->dev_id )) != NULL) )
+                    {
+                    dev->online = 2;
+                    dev->lastRx = MyComms->ticks;
+                    dev->probeInterval = dev->probeQuiet;
+                    }
+                }
+
+            // See if there is a pending packet
+            // used in master mode only
+            if( MyComms->state == kP3StateReplyWaitTxPend )
+                {
+                P3SendPacket( MyComms, &MyComms->ExPak );
+                if( (MyComms->ExPak.command.data[2] & 0x0F) == GLOBAL_DEVICE_ID )
+                    MyComms->state = kP3StateIdle;
+                else
+                    MyComms->state = kP3StateReplyWait;
+                }
+            else
+                {
+                MyComms->state = kP3StateIdle;
+                }
+
+            // master, finish the request this answers
+            if( (MyComms->mode == kP3ModeMaster) && (RxPak->dev_id == MyComms->completeId) )
+                {
+                // slave does not know the mirror group
+                if( MyComms->MirrorWait && (RxPak->chk_sum == 0) &&
+                    (RxPak->masked_cmd1 == CMD1_GROUP_SYSTEM_REPLY) && (RxPak->command.cmdpak.cmd.cmd2 == CMD2_SYSTEM_NAK) )
+                    MyComms->MirrorNakCount++;
+                MyComms->MirrorWait = 0;
+
+                if( RxPak->chk_sum != 0 )
+                    P3CompleteRequest( MyComms, NULL, kP3ReqNak );
+                else
+                if( (RxPak->masked_cmd1 == CMD1_GROUP_SYSTEM_REPLY) && (RxPak->command.cmdpak.cmd.cmd2 == CMD2_SYSTEM_NAK) )
+                    P3CompleteRequest( MyComms, RxPak, kP3ReqNak );
+                else
+                    P3CompleteRequest( MyComms, RxPak, kP3ReqReply );
+                }
+            }
+        }
+
+    // part of a routed frame, send what we have so far
+    if( (MyComms->forward != NULL) && (fwd < MyComms->rxcnt) )
+        MyComms->forward->write_buf( MyComms->forward, &MyComms->rxbuf[fwd], MyComms->rxcnt - fwd );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Decode a received packet and take appropriate action                 */
+/*---------------------------------------------------------------------------*/
+
+void
+P3DecodePacket( p3comms *MyComms, p3pak *packet )
+{
+    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
+    int         ret = 0;
+
+    // cmd not used now
+    cmd = cmd;
+
+    // Slave may have the reply built already
+    if( P3SendPrebuilt( MyComms, packet ) == P3_SUCCESS )
+        return;
+
+    // Decoding in device specific code
+    // If this returns positive then the command was handled
+    if( MyComms->packet_decode != NULL )
+        ret = MyComms->packet_decode( MyComms, packet );
+
+    // Did user code handle the packet
+    if(ret > 0)
+        return;
+
+    // Standard processing of common known commands
+    switch( packet->masked_cmd1 )
+        {
+        case    CMD1_GROUP_SYSTEM_CMD:
+            P3DecodeSysCtl( MyComms, packet );
+            break;
+
+        case    CMD1_GROUP_SYSTEM_REPLY:
+            P3DecodeSysReply( MyComms, packet );
+            break;
+
+        case    CMD1_GROUP_MIRROR:
+        case    CMD1_GROUP_MIRROR_REPLY:
+            P3DecodeMirror( MyComms, packet );
+            break;
+
+        default:
+            // Nak - undefined command, master never replies
+            if( MyComms->mode == kP3ModeSlave )
+                P3Command(MyComms, &Cmd_Nak_Und, packet->dev_id  );
+            break;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Slave - string reply including the terminator, cut to fit            */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3StringReply( p3cmd *reply, unsigned char *str )
+{
+    int     len = strlen( (char *)str );
+
+    if( len > P3_SMALL_MSG - 1 )
+        len = P3_SMALL_MSG - 1;
+    memcpy( reply->data, str, len );
+    reply->data[len] = 0;
+    reply->length = len + 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Decode a received system control packet                              */
+/*---------------------------------------------------------------------------*/
+
+void
+P3DecodeSysCtl( p3comms *MyComms, p3pak *packet )
+{
+    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
+
+    //only action these if slave
+    if( MyComms->mode == kP3ModeMaster )
+        return;
+
+    switch( cmd->cmd2 )
+        {
+        case    CMD2_SYSTEM_DEVICE_TYPE:
+            // Dev type request
+            {
+            unsigned long fp = P3Fingerprint( MyComms );
+
+            Cmd_Dev_Type_Reply.data[0] = MyComms->deviceType[0];
+            Cmd_Dev_Type_Reply.data[1] = MyComms->deviceType[1];
+            // followed by fingerprint so the master can use its cache
+            Cmd_Dev_Type_Reply.data[2] = fp >> 24;
+            Cmd_Dev_Type_Reply.data[3] = fp >> 16;
+            Cmd_Dev_Type_Reply.data[4] = fp >>  8;
+            Cmd_Dev_Type_Reply.data[5] = fp;
+            P3Command(MyComms, &Cmd_Dev_Type_Reply, packet->dev_id  );
+            }
+            break;
+
+        case    CMD2_SYSTEM_MANUFACTURER:
+            // manufacturer request
+            P3StringReply( &Cmd_Manufacturer_Reply, MyComms->manufacturer );
+            P3Command(MyComms, &Cmd_Manufacturer_Reply, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_PRODUCT_NAME:
+            // product name request
+            P3StringReply( &Cmd_ProductName_Reply, MyComms->product_name );
+            P3Command(MyComms, &Cmd_ProductName_Reply, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_SERIAL_NUM:
+            // serial number request
+            P3StringReply( &Cmd_SerialNumber_Reply, MyComms->serial_number );
+            P3Command(MyComms, &Cmd_SerialNumber_Reply, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_FIRMWARE:
+            // firmware version
+            memcpy( Cmd_FirmwareVersion_Reply.data, MyComms->firmware_version, Cmd_FirmwareVersion_Reply.length );
+            P3Command(MyComms, &Cmd_FirmwareVersion_Reply, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_HARDWARE:
+            // hardware version
+            memcpy( Cmd_HardwareVersion_Reply.data, MyComms->hardware_version, Cmd_HardwareVersion_Reply.length );
+            P3Command(MyComms, &Cmd_HardwareVersion_Reply, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_IDENTIFY:
+            // everything in one reply so the master needs one round trip
+            {
+            unsigned char  *p = Cmd_Identify_Reply.data;
+
+            memcpy( &p[0], MyComms->deviceType, 2 );
+            memcpy( &p[2], MyComms->firmware_version, 5 );
+            memcpy( &p[7], MyComms->hardware_version, 3 );
+            p += P3_IDENTIFY_FIXED_LEN;
+
+            p += P3IdentifyPutString( p, MyComms->manufacturer );
+            p += P3IdentifyPutString( p, MyComms->product_name );
+            p += P3IdentifyPutString( p, MyComms->serial_number );
+
+            Cmd_Identify_Reply.length = p - Cmd_Identify_Reply.data;
+            P3Command(MyComms, &Cmd_Identify_Reply, packet->dev_id  );
+            }
+            break;
+
+        case    CMD2_SYSTEM_STAGE:
+            // hold a command, data is cmd1, cmd2, length and data
+            if( (cmd->length < 3) || (cmd->data[2] + 3 != cmd->length) )
+                {
+                P3Command(MyComms, &Cmd_Nak_Para_Err, packet->dev_id  );
+                break;
+                }
+            memcpy( &MyComms->StagePak.command.cmdpak.cmd, cmd->data, cmd->length );
+            MyComms->StagePak.dev_id      = packet->dev_id;
+            MyComms->StagePak.masked_cmd1 = cmd->data[0] & 0x0F;
+            MyComms->stageValid = 1;
+            P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+            break;
+
+        case    CMD2_SYSTEM_COMMIT:
+            // apply the staged command if in one of the groups, a
+            // missing mask means everyone
+            if( MyComms->stageValid &&
+                ((cmd->length == 0) || (cmd->data[0] & MyComms->groupMask)) )
+                {
+                int     noReply = MyComms->noReply;
+
+                // staged command replies are not sent
+                MyComms->stageValid = 0;
+                MyComms->noReply    = 1;
+                P3DecodePacket( MyComms, &MyComms->StagePak );
+                MyComms->noReply    = noReply;
+                }
+            P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+            break;
+
+        default:
+            // Nak - undefined command
+            P3Command(MyComms, &Cmd_Nak_Und, packet->dev_id  );
+            break;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Master - string reply into a device identity, limited to 31          */
+/*      characters and always terminated                                     */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3ReplyString( p3identity *id, unsigned char *str, p3pak *packet )
+{
+    int     len = packet->command.cmdpak.cmd.length;
+
+    if( len > 31 )
+        len = 31;
+    memcpy( str, packet->command.cmdpak.cmd.data, len );
+    str[len] = 0;
+
+    id->dev_id = packet->dev_id;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Decode a received system reply packet                                */
 /*---------------------------------------------------------------------------*/
 
 void
-P3ReceivePacket( p3comms *MyComms )
+P3DecodeSysReply( p3comms *MyComms, p3pak *packet )
 {
-    int             i;
-    p3pak           *RxPak;
+    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
+    p3device    *dev = P3GetDevice( MyComms, packet->dev_id );
+    p3identity  *id;
+    int          len;
 
-    RxPak = &MyComms->RxPak;
+    // why are we here ??
+    if( MyComms->mode == kP3ModeSlave )
+        return;
 
-    for(i=0;i<MyComms->rxcnt;i++)
+    switch( cmd->cmd2 )
         {
-        switch( RxPak->cmd_cnt )
-            {
-            case    0: // should be preamble 1
-                if( MyComms->rxbuf[i] == P3_PREAMBLE1 )
-                    {
-                    // for debug
-                    RxPak->command.cmdpak.preamble1 = P3_PREAMBLE1;
-                    RxPak->cmd_cnt = 1;
-                    }
-                else
-                    RxPak->cmd_cnt = 0;
+        case    CMD2_SYSTEM_ACK:   // ACK
+            if( (dev != NULL) && (cmd->length > 0) && (cmd->data[0] & P3_ACK_HEARTBEAT) )
+                {
+                dev->lastHeartbeat = MyComms->ticks;
+                dev->heartbeats++;
+                }
+            break;
+
+        case    CMD2_SYSTEM_NAK:   // NAK
+            break;
+
+        case    CMD2_SYSTEM_DEVICE_TYPE:
+            // Dev type reply
+            if( dev == NULL )
                 break;
+            id = &dev->identity;
+            id->dev_id = packet->dev_id;
+            id->deviceType[0] = cmd->data[0];
+            id->deviceType[1] = cmd->data[1];
+
+            // newer slaves add their fingerprint
+            if( cmd->length >= P3_DEVICE_TYPE_LEN + P3_FINGERPRINT_LEN )
+                dev->fingerprint = ((unsigned long)cmd->data[2] << 24) |
+                                   ((unsigned long)cmd->data[3] << 16) |
+                                   ((unsigned long)cmd->data[4] <<  8) |
+                                    (unsigned long)cmd->data[5];
+            else
+                dev->fingerprint = 0;
+            break;
 
-            case    1: // should be preamble 2
-                if( MyComms->rxbuf[i] == P3_PREAMBLE2 )
-                    {
-                    // for debug
-                    RxPak->command.cmdpak.preamble2 = P3_PREAMBLE2;
-                    RxPak->chk_sum = P3_PREAMBLE1 ^ P3_PREAMBLE2;
-                    RxPak->cmd_cnt = 2;
-                    }
-                else
-                    RxPak->cmd_cnt = 0;
+
+        case   CMD2_SYSTEM_MANUFACTURER:
+            // Manufacturer string
+            if( dev != NULL )
+                P3ReplyString( &dev->identity, dev->identity.manufacturer, packet );
+            break;
+
+       case   CMD2_SYSTEM_PRODUCT_NAME:
+            // product name string
+            if( dev != NULL )
+                P3ReplyString( &dev->identity, dev->identity.product_name, packet );
+            break;
+
+       case   CMD2_SYSTEM_SERIAL_NUM:
+            // serial number string
+            if( dev != NULL )
+                P3ReplyString( &dev->identity, dev->identity.serial_number, packet );
+            break;
+
+        case CMD2_SYSTEM_FIRMWARE:
+            // firmware version
+            if( dev == NULL )
                 break;
+            dev->identity.dev_id = packet->dev_id;
+            memcpy( dev->identity.firmware_version, cmd->data, 5 );
+            break;
 
-            case    2:
-                RxPak->command.cmdpak.cmd.cmd1 = MyComms->rxbuf[i]; // don;t mask now
-                RxPak->dev_id  = MyComms->rxbuf[i] & 0x0F;
-                RxPak->masked_cmd1 = (MyComms->rxbuf[i] >> 4) & 0x0F;
-                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
-                RxPak->cmd_cnt++;
+        case CMD2_SYSTEM_HARDWARE:
+            // hardware version
+            if( dev == NULL )
                 break;
+            dev->identity.dev_id = packet->dev_id;
+            memcpy( dev->identity.hardware_version, cmd->data, 3 );
+            break;
 
-            case    3:
-                RxPak->command.cmdpak.cmd.cmd2 = MyComms->rxbuf[i];
-                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
-                RxPak->cmd_cnt++;
+        case CMD2_SYSTEM_IDENTIFY:
+            // combined identity, ignore if too short for the fixed part
+            {
+            unsigned char  *p = cmd->data;
+            int             avail = cmd->length;
+
+            if( (dev == NULL) || (avail < P3_IDENTIFY_FIXED_LEN) )
                 break;
 
-            case    4:
-                RxPak->command.cmdpak.cmd.length = MyComms->rxbuf[i];
-                RxPak->cmd_len = MyComms->rxbuf[i] + 6;
-                RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
-                RxPak->cmd_cnt++;
-                break;
+            id = &dev->identity;
+            id->dev_id = packet->dev_id;
+            memcpy( id->deviceType, &p[0], 2 );
+            memcpy( id->firmware_version, &p[2], 5 );
+            memcpy( id->hardware_version, &p[7], 3 );
+            p     += P3_IDENTIFY_FIXED_LEN;
+            avail -= P3_IDENTIFY_FIXED_LEN;
+
+            len = P3IdentifyGetString( id->manufacturer, p, avail );
+            p += len; avail -= len;
+            len = P3IdentifyGetString( id->product_name, p, avail );
+            p += len; avail -= len;
+            P3IdentifyGetString( id->serial_number, p, avail );
+            }
+            break;
+
+        default:
+            break;
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Master - state for a device, NULL for the global id                  */
+/*---------------------------------------------------------------------------*/
+
+p3device *
+P3GetDevice( p3comms *MyComms, int dev_id )
+{
+    dev_id &= 0x0F;
+
+    if( dev_id >= P3_MAX_DEVICES )
+        return( NULL );
+
+    return( &MyComms->device[dev_id] );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Master - probe dest_id after quiet calls with no valid traffic       */
+/*      from it, quiet of 0 turns probing off.  Call once for each device    */
+/*---------------------------------------------------------------------------*/
+
+void
+P3SetLiveness( p3comms *MyComms, int dest_id, int quiet )
+{
+    p3device    *dev;
+
+    if( (dev = P3GetDevice( MyComms, dest_id )) == NULL )
+        return;
+
+    dev->probeQuiet    = quiet;
+    dev->probeInterval = quiet;
+    dev->probeAt       = MyComms->ticks;
+
+    // first probe goes out straight away
+    dev->lastRx        = MyComms->ticks - quiet;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Slave - application is alive, sent with the next ACK                 */
+/*---------------------------------------------------------------------------*/
+
+void
+P3Heartbeat( p3comms *MyComms )
+{
+    MyComms->heartbeat = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Master - device application sent a heartbeat in the last quiet       */
+/*      ticks.  The link alone can be up with the application stalled        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3DeviceAlive( p3comms *MyComms, int dev_id, int quiet )
+{
+    p3device    *dev = P3GetDevice( MyComms, dev_id );
+
+    if( (dev == NULL) || (dev->online == 0) || (dev->heartbeats == 0) )
+        return( 0 );
+
+    return( (long)(MyComms->ticks - dev->lastHeartbeat) <= quiet );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identity fingerprint, FNV-1a hash of device type, serial number      */
+/*      and firmware version.  Never 0 as that means no fingerprint          */
+/*---------------------------------------------------------------------------*/
+
+static unsigned long
+P3FingerprintOf( unsigned char *deviceType, unsigned char *serial_number, unsigned char *firmware_version )
+{
+    unsigned long   hash = 2166136261UL;
+    unsigned char  *p;
+    int             i;
+
+    for(i=0;i<2;i++)
+        hash = ((hash ^ deviceType[i]) * 16777619UL) & 0xFFFFFFFFUL;
+    for(p=serial_number;p<&serial_number[SERIAL_NUMBER_STRING_LEN] && *p!=0;p++)
+        hash = ((hash ^ *p) * 16777619UL) & 0xFFFFFFFFUL;
+    for(i=0;i<5;i++)
+        hash = ((hash ^ firmware_version[i]) * 16777619UL) & 0xFFFFFFFFUL;
+
+    if( hash == 0 )
+        hash = 1;
+
+    return( hash );
+}
+
+unsigned long
+P3Fingerprint( p3comms *MyComms )
+{
+    return( P3FingerprintOf( MyComms->deviceType, MyComms->serial_number, MyComms->firmware_version ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identity cache - identity decoded from a device, NULL if none        */
+/*---------------------------------------------------------------------------*/
+
+p3identity *
+P3IdentityLookup( p3comms *MyComms, int dev_id )
+{
+    p3device    *dev;
+
+    if( (dev = P3GetDevice( MyComms, dev_id )) == NULL )
+        return( NULL );
+
+    if( dev->identity.dev_id != (dev_id & 0x0F) )
+        return( NULL );
+
+    return( &dev->identity );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identity cache - the identity just fetched from a device is          */
+/*      complete, remember its fingerprint                                   */
+/*---------------------------------------------------------------------------*/
+
+void
+P3IdentitySave( p3comms *MyComms, int dev_id )
+{
+    p3identity  *id;
+
+    if( (id = P3IdentityLookup( MyComms, dev_id )) == NULL )
+        return;
+
+    id->fingerprint = P3FingerprintOf( id->deviceType, id->serial_number, id->firmware_version );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identity cache - the saved identity is still current if the          */
+/*      fingerprint from the last device type reply matches                  */
+/*---------------------------------------------------------------------------*/
+
+int
+P3IdentityRestore( p3comms *MyComms, int dev_id )
+{
+    p3device    *dev = P3GetDevice( MyComms, dev_id );
+    p3identity  *id;
+
+    if( (id = P3IdentityLookup( MyComms, dev_id )) == NULL )
+        return( P3_FAILURE );
+
+    if( dev->fingerprint == 0 || dev->fingerprint != id->fingerprint )
+        return( P3_FAILURE );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identify - add a length prefixed string to the reply                 */
+/*      strings are limited to 31 characters, returns bytes used             */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3IdentifyPutString( unsigned char *p, unsigned char *str )
+{
+    int     len = strlen( (char *)str );
+
+    if( len > 31 )
+        len = 31;
+
+    p[0] = len;
+    memcpy( &p[1], str, len );
+
+    return( len + 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Identify - extract a length prefixed string from the reply           */
+/*      a truncated reply leaves an empty string, returns bytes used         */
+/*---------------------------------------------------------------------------*/
+
+static int
+P3IdentifyGetString( unsigned char *str, unsigned char *p, int avail )
+{
+    int     len;
+
+    if( avail < 1 || p[0] > 31 || p[0] + 1 > avail )
+        {
+        str[0] = 0;
+        return( avail );
+        }
+
+    len = p[0];
+    memcpy( str, &p[1], len );
+    str[len] = 0;
+
+    return( len + 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Mirror - write to our mirrored state                                 */
+/*      only bytes that change are marked for sending                        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3MirrorWrite( p3comms *MyComms, int offset, unsigned char *data, int len )
+{
+    p3mirror    *mirror = &MyComms->MirrorTx;
+    int         i;
+
+    if( (offset < 0) || (len < 0) || (offset + len > P3_MIRROR_SIZE) )
+        return( P3_FAILURE );
+
+    for(i=offset;i<(offset+len);i++,data++)
+        {
+        if( mirror->data[i] != *data )
+            {
+            // data must be written before the dirty bit is set
+            mirror->data[i] = *data;
+            P3_ATOMIC_OR( &mirror->dirty[i >> 5], 1U << (i & 31) );
+            }
+        }
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Mirror - read from our copy of the remote state                      */
+/*---------------------------------------------------------------------------*/
+
+int
+P3MirrorRead( p3comms *MyComms, int offset, unsigned char *data, int len )
+{
+    if( (offset < 0) || (len < 0) || (offset + len > P3_MIRROR_SIZE) )
+        return( P3_FAILURE );
+
+    memcpy( data, &MyComms->MirrorRx[offset], len );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Mirror - encode dirty ranges into a command                          */
+/*      data[0] is left for flags, each range is offset, length and data     */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3MirrorEncode( p3mirror *mirror, p3cmdfull *cmd )
+{
+    unsigned int    dirty[P3_MIRROR_WORDS];
+    unsigned int    sent[P3_MIRROR_WORDS];
+    unsigned char   *q = &cmd->data[1];
+    int             i, start, end, len, room;
 
+    // take the dirty map, anything unacknowledged is sent again
+    for(i=0;i<P3_MIRROR_WORDS;i++)
+        {
+        dirty[i] = P3_ATOMIC_AND( &mirror->dirty[i], 0 ) | mirror->inflight[i];
+        sent[i]  = 0;
+        }
 
-            default:
-                if( RxPak->cmd_cnt < (RxPak->cmd_len) )
-                    {
-                    RxPak->command.cmdpak.cmd.data[RxPak->cmd_cnt-5] = MyComms->rxbuf[i];
-                    RxPak->chk_sum = RxPak->chk_sum ^ MyComms->rxbuf[i];
-                    RxPak->cmd_cnt++;
-                    }
-             }
+    cmd->length = 1;
 
-        // Look for packet end / 2-April-13 added test for cmd_cmd > 0
-        if( (RxPak->cmd_cnt > 0) && (RxPak->cmd_cnt == RxPak->cmd_len) )
-            {
-            if(MyComms->DebugRx)
-                P3DebugPacket( RxPak );
+    for(start=0;start<P3_MIRROR_SIZE;start++)
+        {
+        if( !P3_MIRROR_TEST( dirty, start ) )
+            continue;
 
-            if( RxPak->chk_sum != 0 )
-                {
-                // 2-April-13, only nak if we are slave
-                // checksum error
-                if( MyComms->mode == kP3ModeSlave )
-                    P3Command(MyComms, &Cmd_Nak_Chksum , RxPak->dev_id );
-                }
+        // find the end of this range, a short clean gap costs less
+        // than the header for another range so include it
+        end = start + 1;
+        for(i=start+1;i<P3_MIRROR_SIZE;i++)
+            {
+            if( P3_MIRROR_TEST( dirty, i ) )
+                end = i + 1;
             else
-                P3DecodePacket( MyComms, &MyComms->RxPak );
+            if( (i - end) >= P3_MIRROR_GAP )
+                break;
+            }
 
-            // clear timeout
-            MyComms->rxto   = 0;
-            RxPak->cmd_cnt  = 0;
+        // no room for any more, remaining bytes go next time
+        room = P3_FULL_MSG - cmd->length - 2;
+        if( room <= 0 )
+            break;
 
-            // slave is online - used in master mode only
-            MyComms->online = 2;
+        len = end - start;
+        if( len > room )
+            len = room;
 
-            // See if there is a pending packet
-            // used in master mode only
-            if( MyComms->state == kP3StateReplyWaitTxPend )
-                {
-                P3SendPacket( MyComms, &MyComms->ExPak );
-                MyComms->state = kP3StateReplyWait;
-                }
-            else
+        *q++ = start;
+        *q++ = len;
+        memcpy( q, &mirror->data[start], len );
+        q += len;
+        cmd->length += len + 2;
+
+        for(i=start;i<(start+len);i++)
+            {
+            if( P3_MIRROR_TEST( dirty, i ) )
                 {
-                MyComms->state = kP3StateIdle;
+                sent[i >> 5]  |=   1U << (i & 31);
+                dirty[i >> 5] &= ~(1U << (i & 31));
                 }
             }
+
+        start += len - 1;
+        }
+
+    // put back what did not fit
+    for(i=0;i<P3_MIRROR_WORDS;i++)
+        {
+        if( dirty[i] != 0 )
+            P3_ATOMIC_OR( &mirror->dirty[i], dirty[i] );
+        mirror->inflight[i] = sent[i];
         }
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Decode a received packet and take appropriate action                 */
+/*      Mirror - master sends changes and the slave replies with its own     */
+/*      can be called from any task, the sync is sent by the comms task      */
+/*---------------------------------------------------------------------------*/
+
+int
+P3MirrorSync( p3comms *MyComms, int dest_id )
+{
+    // master only, and not until the previous sync has gone
+    if( MyComms->mode != kP3ModeMaster )
+        return( P3_FAILURE );
+    if( !__sync_bool_compare_and_swap( &MyComms->MirrorSyncId, 0, (dest_id & 0x0F) + 1 ) )
+        return( P3_FAILURE );
+
+    if( MyComms->wake != NULL )
+        MyComms->wake( MyComms, MyComms->wakeContext );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Mirror - decode a received sync or sync reply                        */
 /*---------------------------------------------------------------------------*/
 
 void
-P3DecodePacket( p3comms *MyComms, p3pak *packet )
+P3DecodeMirror( p3comms *MyComms, p3pak *packet )
 {
     p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
-    int         ret = 0;
+    p3device    *dev;
+    int         i, offset, len;
 
-    // cmd not used now
-    cmd = cmd;
+    if( (cmd->cmd2 != CMD2_MIRROR_SYNC) || (cmd->length < 1) )
+        {
+        if( MyComms->mode == kP3ModeSlave )
+            P3Command(MyComms, &Cmd_Nak_Para_Err, packet->dev_id  );
+        return;
+        }
 
-    // Decoding in device specific code
-    // If this returns positive then the command was handled
-    if( MyComms->packet_decode != NULL )
-        ret = MyComms->packet_decode( MyComms, packet );
+    if( MyComms->mode == kP3ModeSlave )
+        {
+        // master saw our last reply so inflight is done with, without
+        // the flag it is sent again with the next reply
+        if( cmd->data[0] & P3_MIRROR_FLAG_ACK )
+            memset( MyComms->MirrorTx.inflight, 0, sizeof(MyComms->MirrorTx.inflight) );
+        }
+    else
+        {
+        // reply means the slave has our changes
+        memset( MyComms->MirrorTx.inflight, 0, sizeof(MyComms->MirrorTx.inflight) );
+        MyComms->MirrorAck = 1;
 
-    // Did user code handle the packet
-    if(ret > 0)
-        return;
+        if( (cmd->data[0] & P3_MIRROR_FLAG_HEARTBEAT) && ((dev = P3GetDevice( MyComms, packet->dev_id )) != NULL) )
+            {
+            dev->lastHeartbeat = MyComms->ticks;
+            dev->heartbeats++;
+            }
+        }
 
-    // Standard processing of common known commands
-    switch( packet->masked_cmd1 )
+    // copy ranges into the remote state
+    for(i=1;(i+2)<=cmd->length;i+=len)
         {
-        case    CMD1_GROUP_SYSTEM_CMD:
-            P3DecodeSysCtl( MyComms, packet );
-            break;
+        offset = cmd->data[i++];
+        len    = cmd->data[i++];
 
-        case    CMD1_GROUP_SYSTEM_REPLY:
-            P3DecodeSysReply( MyComms, packet );
+        if( (offset + len > P3_MIRROR_SIZE) || (i + len > cmd->length) )
             break;
 
-        default:
-            // Nak - undefined command
-            P3Command(MyComms, &Cmd_Nak_Und, packet->dev_id  );
-            break;
+        memcpy( &MyComms->MirrorRx[offset], &cmd->data[i], len );
+        }
+    MyComms->MirrorRxCount++;
+
+    // slave replies with its own changes
+    if( MyComms->mode == kP3ModeSlave )
+        {
+        P3MirrorEncode( &MyComms->MirrorTx, &Cmd_Mirror_Reply );
+        Cmd_Mirror_Reply.data[0] = MyComms->heartbeat ? P3_MIRROR_FLAG_HEARTBEAT : 0;
+        MyComms->heartbeat = 0;
+        P3Command(MyComms, &Cmd_Mirror_Reply, packet->dev_id  );
         }
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Decode a received system control packet                              */
+/*      Command queue - clear                                                */
 /*---------------------------------------------------------------------------*/
 
 void
-P3DecodeSysCtl( p3comms *MyComms, p3pak *packet )
+P3QueueInit( p3cmdqueue *queue )
 {
-    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
+    queue->head = 0;
+    queue->tail = 0;
+}
 
-    //only action these if slave
-    if( MyComms->mode == kP3ModeMaster )
-        return;
+/*---------------------------------------------------------------------------*/
+/*      Command queue - add a command, producer task only                    */
+/*---------------------------------------------------------------------------*/
 
-    switch( cmd->cmd2 )
-        {
-        case    CMD2_SYSTEM_DEVICE_TYPE:
-            // Dev type request
-            Cmd_Dev_Type_Reply.data[0] = MyComms->deviceType[0];
-            Cmd_Dev_Type_Reply.data[1] = MyComms->deviceType[1];
-            P3Command(MyComms, &Cmd_Dev_Type_Reply, packet->dev_id  );
-            break;
+int
+P3QueuePut( p3cmdqueue *queue, void *command )
+{
+    p3cmdfull   *MyCmd = (p3cmdfull *)command;
+    unsigned int head = queue->head;
 
-        case    CMD2_SYSTEM_MANUFACTURER:
-            // manufacturer request
-            Cmd_Manufacturer_Reply.length = strlen( (char *)MyComms->manufacturer ) + 1;
-            strncpy( (char *)Cmd_Manufacturer_Reply.data, (char *)MyComms->manufacturer, Cmd_Manufacturer_Reply.length );
-            P3Command(MyComms, &Cmd_Manufacturer_Reply, packet->dev_id  );
-            break;
+    // full or too long to store
+    if( ((head - queue->tail) >= P3_CMD_QUEUE_SIZE) || (MyCmd->length > P3_SMALL_MSG) )
+        return( P3_FAILURE );
 
-        case    CMD2_SYSTEM_PRODUCT_NAME:
-            // product name request
-            Cmd_ProductName_Reply.length = strlen( (char *)MyComms->product_name ) + 1;
-            strncpy( (char *)Cmd_ProductName_Reply.data, (char *)MyComms->product_name, Cmd_ProductName_Reply.length );
-            P3Command(MyComms, &Cmd_ProductName_Reply, packet->dev_id  );
-            break;
+    memcpy( &queue->cmd[ head & (P3_CMD_QUEUE_SIZE-1) ], MyCmd, MyCmd->length + 3 );
 
-        case    CMD2_SYSTEM_SERIAL_NUM:
-            // serial number request
-            Cmd_SerialNumber_Reply.length = strlen( (char *)MyComms->serial_number ) + 1;
-            strncpy( (char *)Cmd_SerialNumber_Reply.data, (char *)MyComms->serial_number, Cmd_SerialNumber_Reply.length );
-            P3Command(MyComms, &Cmd_SerialNumber_Reply, packet->dev_id  );
-            break;
+    // command must be complete before the consumer can see it
+    P3_MEMORY_BARRIER();
+    queue->head = head + 1;
 
-        case    CMD2_SYSTEM_FIRMWARE:
-            // firmware version
-            strncpy( (char *)Cmd_FirmwareVersion_Reply.data, (char *)MyComms->firmware_version, Cmd_FirmwareVersion_Reply.length );
-            P3Command(MyComms, &Cmd_FirmwareVersion_Reply, packet->dev_id  );
-            break;
+    return( P3_SUCCESS );
+}
 
-        case    CMD2_SYSTEM_HARDWARE:
-            // hardware version
-            strncpy( (char *)Cmd_HardwareVersion_Reply.data,(char *) MyComms->hardware_version, Cmd_HardwareVersion_Reply.length );
-            P3Command(MyComms, &Cmd_HardwareVersion_Reply, packet->dev_id  );
-            break;
+/*---------------------------------------------------------------------------*/
+/*      Command queue - remove a command, consumer task only                 */
+/*---------------------------------------------------------------------------*/
 
-        default:
-            // Nak - undefined command
-            P3Command(MyComms, &Cmd_Nak_Und, packet->dev_id  );
-            break;
-        }
+int
+P3QueueGet( p3cmdqueue *queue, p3cmd *command )
+{
+    unsigned int tail = queue->tail;
+    p3cmd       *MyCmd;
+
+    if( tail == queue->head )
+        return( P3_FAILURE );
+
+    P3_MEMORY_BARRIER();
+    MyCmd = &queue->cmd[ tail & (P3_CMD_QUEUE_SIZE-1) ];
+    memcpy( command, MyCmd, MyCmd->length + 3 );
+
+    // copy must be complete before the slot is reused
+    P3_MEMORY_BARRIER();
+    queue->tail = tail + 1;
+
+    return( P3_SUCCESS );
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Decode a received system reply packet                                */
+/*      Prebuilt - register a status reply the slave builds while idle       */
+/*      refresh is called as int refresh( p3comms *MyComms, p3cmd *reply )   */
+/*      and should fill reply data, only requests without data can use this  */
 /*---------------------------------------------------------------------------*/
 
-void
-P3DecodeSysReply( p3comms *MyComms, p3pak *packet )
+int
+P3RegisterPrebuilt( p3comms *MyComms, int cmd1, int cmd2, p3cmd *reply, void *refresh )
 {
-    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
-    int          len;
+    p3prebuilt  *pb;
 
-    // why are we here ??
-    if( MyComms->mode == kP3ModeSlave )
+    if( (MyComms->mode != kP3ModeSlave) || (MyComms->prebuiltCount == P3_MAX_PREBUILT) )
+        return( P3_FAILURE );
+
+    pb = &MyComms->prebuilt[ MyComms->prebuiltCount ];
+    pb->cmd1    = cmd1;
+    pb->cmd2    = cmd2;
+    pb->reply   = reply;
+    pb->refresh = refresh;
+    pb->front   = -1;
+
+    MyComms->prebuiltCount++;
+
+    // build the first frame now so it is ready for the first request
+    P3BuildPrebuilt( MyComms, pb );
+
+    return( P3_SUCCESS );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Prebuilt - rebuild one reply into its back buffer                    */
+/*---------------------------------------------------------------------------*/
+
+static void
+P3BuildPrebuilt( p3comms *MyComms, p3prebuilt *pb )
+{
+    int         back;
+
+    if( (pb->refresh( MyComms, pb->reply ) <= 0) || (pb->reply->length > P3_SMALL_MSG) )
         return;
 
-    switch( cmd->cmd2 )
-        {
-        case    CMD2_SYSTEM_ACK:   // ACK
-        case    CMD2_SYSTEM_NAK:   // NAK
-            break;
+    // encoded for device 0, the real id is patched in when sent
+    back = (pb->front == 0) ? 1 : 0;
+    pb->frame_len[back] = P3EncodeFrame( pb->frame[back], pb->reply, 0 );
+    pb->front = back;
+}
 
-        case    CMD2_SYSTEM_DEVICE_TYPE:
-            // Dev type reply
-            MyComms->deviceType[0] = packet->command.cmdpak.cmd.data[0];
-            MyComms->deviceType[1] = packet->command.cmdpak.cmd.data[1];
-            break;
+/*---------------------------------------------------------------------------*/
+/*      Prebuilt - rebuild the next reply, callers that run on a tick        */
+/*---------------------------------------------------------------------------*/
 
+void
+P3RefreshPrebuilt( p3comms *MyComms )
+{
+    if( MyComms->prebuiltCount == 0 )
+        return;
 
-        case   CMD2_SYSTEM_MANUFACTURER:
-            // Manufacturer string
-            len = packet->command.cmdpak.cmd.length;
-            if( len > 31 )
-                len = 31;
-            strncpy( (char *)MyComms->manufacturer, (char *)packet->command.cmdpak.cmd.data, len );
-            break;
+    // one reply each call to limit time spent here
+    if( MyComms->prebuiltNext >= MyComms->prebuiltCount )
+        MyComms->prebuiltNext = 0;
+    P3BuildPrebuilt( MyComms, &MyComms->prebuilt[ MyComms->prebuiltNext++ ] );
+}
 
-       case   CMD2_SYSTEM_PRODUCT_NAME:
-            // product name string
-            len = packet->command.cmdpak.cmd.length;
-            if( len > 31 )
-                len = 31;
-            strncpy( (char *)MyComms->product_name, (char *)packet->command.cmdpak.cmd.data, len );
-            break;
+/*---------------------------------------------------------------------------*/
+/*      Prebuilt - send a ready reply if we have one for this request        */
+/*---------------------------------------------------------------------------*/
 
-       case   CMD2_SYSTEM_SERIAL_NUM:
-            // serial number string
-            len = packet->command.cmdpak.cmd.length;
-            if( len > 31 )
-                len = 31;
-            strncpy( (char *)MyComms->serial_number, (char *)packet->command.cmdpak.cmd.data, len );
-            break;
+int
+P3SendPrebuilt( p3comms *MyComms, p3pak *packet )
+{
+    p3prebuilt      *pb;
+    p3pak           *MyPak = &MyComms->TxPak;
+    unsigned char   id;
+    int             i;
 
-        case CMD2_SYSTEM_FIRMWARE:
-            // firmware version
-            strncpy( (char *)MyComms->firmware_version, (char *)packet->command.cmdpak.cmd.data, 5 );
-            break;
+    if( (MyComms->mode != kP3ModeSlave) || (packet->command.cmdpak.cmd.length != 0) )
+        return( P3_FAILURE );
 
-        case CMD2_SYSTEM_HARDWARE:
-            // hardware version
-            strncpy( (char *)MyComms->hardware_version, (char *)packet->command.cmdpak.cmd.data, 5 );
-            break;
+    for(i=0;i<MyComms->prebuiltCount;i++)
+        {
+        pb = &MyComms->prebuilt[i];
+        if( (pb->cmd1 == packet->masked_cmd1) && (pb->cmd2 == packet->command.cmdpak.cmd.cmd2) && (pb->front >= 0) )
+            {
+            memcpy( MyPak->command.data, pb->frame[pb->front], pb->frame_len[pb->front] );
+            MyPak->cmd_len = pb->frame_len[pb->front];
 
-        default:
-            break;
+            // patch destination and fix checksum
+            id = (MyPak->command.data[2] & 0xF0) | (packet->dev_id & 0x0F);
+            MyPak->command.data[ MyPak->cmd_len - 1 ] ^= MyPak->command.data[2] ^ id;
+            MyPak->command.data[2] = id;
+            MyPak->chk_sum = MyPak->command.data[ MyPak->cmd_len - 1 ];
+
+            P3SendPacket( MyComms, MyPak );
+
+            // rebuild while the reply goes out, an event driven caller
+            // may never have a quiet pass for P3RefreshPrebuilt
+            P3BuildPrebuilt( MyComms, pb );
+            return( P3_SUCCESS );
+            }
         }
+
+    return( P3_FAILURE );
 }
 
 /*---------------------------------------------------------------------------*/
@@ -864,8 +2701,26 @@ P3DecodeSysReply( p3comms *MyComms, p3pak *packet )
 
 int
 P3CommsTask( p3comms *MyComms )
+{
+    return( P3CommsRun( MyComms, 1 ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*      Run communications after elapsed ticks, for callers that only run    */
+/*      a channel when it has data or P3CommsNext says a timer is due        */
+/*---------------------------------------------------------------------------*/
+
+int
+P3CommsRun( p3comms *MyComms, int elapsed )
 {
     int             rx_len;
+    p3device        *dev;
+
+    if( MyComms->closed )
+        return( P3_FAILURE );
+
+    MyComms->ticks += elapsed;
+    MyComms->step   = elapsed;
 
     //Check for receive packet
     if( (rx_len = P3ReceiveData( MyComms )) > 0 )
@@ -874,6 +2729,10 @@ P3CommsTask( p3comms *MyComms )
         }
     else
         {
+        // slave with nothing being received has time to build replies
+        if( (MyComms->mode == kP3ModeSlave) && (MyComms->RxPak.cmd_cnt == 0) )
+            P3RefreshPrebuilt( MyComms );
+
         if( MyComms->mode == kP3ModeMaster )
             {
             if( MyComms->state == kP3StateTimeout )
@@ -882,10 +2741,82 @@ P3CommsTask( p3comms *MyComms )
                 if( MyComms->online > 0 )
                    MyComms->online--;
                 MyComms->tcount++;
+
+                // and for the device that did not answer
+                if( (dev = P3GetDevice( MyComms, MyComms->waitId )) != NULL )
+                    {
+                    if( dev->online > 0 )
+                        dev->online--;
+                    dev->tcount++;
+                    }
+
+                P3CompleteRequest( MyComms, NULL, kP3ReqTimeout );
                 }
             }
         }
 
+    // send anything submitted by other tasks
+    P3SendPending( MyComms );
+
     return(P3_SUCCESS);
 }
 
+/*---------------------------------------------------------------------------*/
+/*      Ticks until the comms task next has work without any received data, */
+/*      0 if it has work now or -1 if it only needs to run when data arrives */
+/*---------------------------------------------------------------------------*/
+
+int
+P3CommsNext( p3comms *MyComms )
+{
+    p3device    *dev;
+    long        next = 0;
+    long        t;
+    int         found = 0;
+    int         i;
+
+    // rest of a frame or a reply is due
+    if( MyComms->rxto > 0 )
+        return( MyComms->rxto );
+
+    // master has one command outstanding at a time
+    if( (MyComms->mode == kP3ModeMaster) && (MyComms->state != kP3StateIdle) )
+        return( -1 );
+
+    // something submitted or a mirror sync asked for
+    if( (MyComms->submit[ MyComms->submitTail & (P3_SUBMIT_QUEUE_SIZE-1) ].seq == (MyComms->submitTail + 1)) ||
+        (MyComms->MirrorSyncId > 0) )
+        return( 0 );
+
+    if( MyComms->mode == kP3ModeSlave )
+        return( -1 );
+
+    // earliest schedule slot
+    for(i=0;i<MyComms->slotCount;i++)
+        {
+        t = (long)(MyComms->slot[i].due - MyComms->ticks);
+        if( !found++ || t < next )
+            next = t;
+        }
+
+    // and earliest liveness probe
+    for(i=0;i<P3_MAX_DEVICES;i++)
+        {
+        dev = &MyComms->device[i];
+        if( dev->probeQuiet == 0 )
+            continue;
+
+        t = (long)(dev->lastRx + dev->probeQuiet - MyComms->ticks);
+        if( (long)(dev->probeAt - MyComms->ticks) > t )
+            t = (long)(dev->probeAt - MyComms->ticks);
+        if( !found++ || t < next )
+            next = t;
+        }
+
+    if( !found )
+        return( -1 );
+
+    // overdue
+    return( next < 0 ? 0 : (int)next );
+}
+
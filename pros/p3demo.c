@@ -71,18 +71,37 @@ static  p3cmd   Cmd_Motor_Status        = { CMD1_GROUP_STATUS_REPLY, CMD2_STATUS
 // System commands
 static  p3cmd   Cmd_Ack                     = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_ACK,          0x01, {0x00} };
 static  p3cmd   Cmd_Nak_Para_Err            = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x08} };
+static  p3cmd   Cmd_Nak_Overrun             = { CMD1_GROUP_SYSTEM_REPLY, CMD2_SYSTEM_NAK,          0x01, {0x20} };
 static  p3cmd   Cmd_Dev_Type                = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_DEVICE_TYPE,  0, {0x00} };
 static  p3cmd   Cmd_Manufacturer_Request    = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_MANUFACTURER, 0, {0x00} };
 static  p3cmd   Cmd_ProductName_Request     = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_PRODUCT_NAME, 0, {0x00} };
 static  p3cmd   Cmd_SerialNumber_Request    = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_SERIAL_NUM,   0, {0x00} };
 static  p3cmd   Cmd_FirmwareRev_Request     = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_FIRMWARE,     0, {0x00} };
 static  p3cmd   Cmd_HardwareRev_Request     = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_HARDWARE,     0, {0x00} };
+static  p3cmd   Cmd_Identify                = { CMD1_GROUP_SYSTEM_CMD, CMD2_SYSTEM_IDENTIFY,     0, {0x00} };
+
+// mirrored state layout, master pushes motor commands and the
+// slave pushes back the current motor values
+#define MIRROR_MOTORS                   0
 
 // storage for the motor date we send to the slave
 static  short   remote_motor[ 10 ];
 
+// schedule slot polling the slave motors
+static  int     motorStatusSlot;
+
+// comms ticks without a heartbeat before the slave application is
+// taken to have stalled, 200mS
+#define HEARTBEAT_QUIET                 100
+
+// control commands decoded by the slave comms task and applied
+// by the actuation task
+static  p3cmdqueue  actuationQueue;
+
 /*---------------------------------------------------------------------------*/
 /*  Example control commands                                                 */
+/*  Commands are checked and queued here, the actuation task sets the motors */
+/*  so the ACK does not wait for hardware writes                             */
 /*---------------------------------------------------------------------------*/
 
 int
@@ -98,20 +117,11 @@ P3UserDecodeControl( p3comms *MyComms, p3pak *packet )
         case   CMD2_CONTROL_SETMOTORS:
             // Check for valid data length
             if( cmd->length == 10 ) {
-                // data is in range 0-254, shift to +/- 127
-                motorSet( 1, cmd->data[0] - 0x7F);
-                motorSet( 2, cmd->data[1] - 0x7F);
-                motorSet( 3, cmd->data[2] - 0x7F);
-                motorSet( 4, cmd->data[3] - 0x7F);
-                motorSet( 5, cmd->data[4] - 0x7F);
-                motorSet( 6, cmd->data[5] - 0x7F);
-                motorSet( 7, cmd->data[6] - 0x7F);
-                motorSet( 8, cmd->data[7] - 0x7F);
-                motorSet( 9, cmd->data[8] - 0x7F);
-                motorSet( 10,cmd->data[9] - 0x7F);
-
-                // Send ACK
-                P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+                // Queue and send ACK, NAK if the actuation task is behind
+                if( P3QueuePut( &actuationQueue, cmd ) == P3_SUCCESS )
+                    P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+                else
+                    P3Command(MyComms, &Cmd_Nak_Overrun, packet->dev_id  );
                 }
             else
                 // Send NAK
@@ -126,11 +136,11 @@ P3UserDecodeControl( p3comms *MyComms, p3pak *packet )
                 index = cmd->data[0];
                 // bounds check the index
                 if( (index >= 0) && (index<=9) ) {
-                    // data is in range 0-254, shift to +/- 127
-                    motorSet( index+1, cmd->data[1] - 0x7F);
-
-                    // Send ACK
-                    P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+                    // Queue and send ACK
+                    if( P3QueuePut( &actuationQueue, cmd ) == P3_SUCCESS )
+                        P3Command(MyComms, &Cmd_Ack, packet->dev_id  );
+                    else
+                        P3Command(MyComms, &Cmd_Nak_Overrun, packet->dev_id  );
                     }
                 else
                     P3Command(MyComms, &Cmd_Nak_Para_Err, packet->dev_id  );
@@ -148,72 +158,80 @@ P3UserDecodeControl( p3comms *MyComms, p3pak *packet )
 }
 
 /*---------------------------------------------------------------------------*/
-/*  Example status request and reply                                         */
+/*  Apply a queued control command, already checked by the decode            */
 /*---------------------------------------------------------------------------*/
 
-int
-P3UserDecodeStatus( p3comms *MyComms, p3pak *packet )
+void
+P3UserActuate( p3cmd *cmd )
 {
-    p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
-    int          ret = 1;
-
     switch( cmd->cmd2 )
         {
-        // Get all motors
-        case    CMD2_STATUS_GETMOTORS:
-            // shift +- 127 to 0-254 range
-            Cmd_Motor_Status.data[0] = motorGet( 1 ) + 0x7F;
-            Cmd_Motor_Status.data[1] = motorGet( 2 ) + 0x7F;
-            Cmd_Motor_Status.data[2] = motorGet( 3 ) + 0x7F;
-            Cmd_Motor_Status.data[3] = motorGet( 4 ) + 0x7F;
-            Cmd_Motor_Status.data[4] = motorGet( 5 ) + 0x7F;
-            Cmd_Motor_Status.data[5] = motorGet( 6 ) + 0x7F;
-            Cmd_Motor_Status.data[6] = motorGet( 7 ) + 0x7F;
-            Cmd_Motor_Status.data[7] = motorGet( 8 ) + 0x7F;
-            Cmd_Motor_Status.data[8] = motorGet( 9 ) + 0x7F;
-            Cmd_Motor_Status.data[9] = motorGet( 10) + 0x7F;
-            // reply with motor status
-            P3Command(MyComms, &Cmd_Motor_Status, packet->dev_id  );
+        // Set all motors
+        case   CMD2_CONTROL_SETMOTORS:
+            // data is in range 0-254, shift to +/- 127
+            motorSet( 1, cmd->data[0] - 0x7F);
+            motorSet( 2, cmd->data[1] - 0x7F);
+            motorSet( 3, cmd->data[2] - 0x7F);
+            motorSet( 4, cmd->data[3] - 0x7F);
+            motorSet( 5, cmd->data[4] - 0x7F);
+            motorSet( 6, cmd->data[5] - 0x7F);
+            motorSet( 7, cmd->data[6] - 0x7F);
+            motorSet( 8, cmd->data[7] - 0x7F);
+            motorSet( 9, cmd->data[8] - 0x7F);
+            motorSet( 10,cmd->data[9] - 0x7F);
+            break;
+
+        // Set motor by index
+        case   CMD2_CONTROL_SET_MOTOR_BY_INDEX:
+            motorSet( cmd->data[0]+1, cmd->data[1] - 0x7F);
             break;
 
         default:
-            ret = 0;
             break;
         }
+}
 
-    return(ret);
+/*---------------------------------------------------------------------------*/
+/*  Fill in motor status, used for requests and the prebuilt reply           */
+/*---------------------------------------------------------------------------*/
+
+int
+P3UserMotorStatus( p3comms *MyComms, p3cmd *reply )
+{
+    (void)MyComms;
+
+    // shift +- 127 to 0-254 range
+    reply->data[0] = motorGet( 1 ) + 0x7F;
+    reply->data[1] = motorGet( 2 ) + 0x7F;
+    reply->data[2] = motorGet( 3 ) + 0x7F;
+    reply->data[3] = motorGet( 4 ) + 0x7F;
+    reply->data[4] = motorGet( 5 ) + 0x7F;
+    reply->data[5] = motorGet( 6 ) + 0x7F;
+    reply->data[6] = motorGet( 7 ) + 0x7F;
+    reply->data[7] = motorGet( 8 ) + 0x7F;
+    reply->data[8] = motorGet( 9 ) + 0x7F;
+    reply->data[9] = motorGet( 10) + 0x7F;
+
+    return(1);
 }
 
 /*---------------------------------------------------------------------------*/
-/*  Example status reply decode                                              */
+/*  Example status request and reply                                         */
 /*---------------------------------------------------------------------------*/
 
 int
-P3UserDecodeStatusReply( p3comms *MyComms, p3pak *packet )
+P3UserDecodeStatus( p3comms *MyComms, p3pak *packet )
 {
     p3cmdfull   *cmd = &packet->command.cmdpak.cmd;
     int          ret = 1;
 
-    (void)MyComms;
-
     switch( cmd->cmd2 )
         {
         // Get all motors
         case    CMD2_STATUS_GETMOTORS:
-            // Check for valid data length
-            if( cmd->length == 10 ) {
-                // data is in range 0-254, shift to +/- 127
-                remote_motor[0]  = cmd->data[0] - 0x7F;
-                remote_motor[1]  = cmd->data[1] - 0x7F;
-                remote_motor[2]  = cmd->data[2] - 0x7F;
-                remote_motor[3]  = cmd->data[3] - 0x7F;
-                remote_motor[4]  = cmd->data[4] - 0x7F;
-                remote_motor[5]  = cmd->data[5] - 0x7F;
-                remote_motor[6]  = cmd->data[6] - 0x7F;
-                remote_motor[7]  = cmd->data[7] - 0x7F;
-                remote_motor[8]  = cmd->data[8] - 0x7F;
-                remote_motor[9]  = cmd->data[9] - 0x7F;
-                }
+            P3UserMotorStatus( MyComms, &Cmd_Motor_Status );
+            // reply with motor status
+            P3Command(MyComms, &Cmd_Motor_Status, packet->dev_id  );
             break;
 
         default:
@@ -225,27 +243,37 @@ P3UserDecodeStatusReply( p3comms *MyComms, p3pak *packet )
 }
 
 /*---------------------------------------------------------------------------*/
-/*      Decode a received packet and take appropriate action                 */
+/*  Example status reply, called by the comms task when the request finishes */
 /*---------------------------------------------------------------------------*/
 
-int
-P3UserDecodePacketMaster( p3comms *MyComms, p3pak *packet )
+void
+P3UserMotorStatusDone( p3comms *MyComms, p3pak *reply, p3reqstatus status, void *context )
 {
-    int     ret = 1;
+    p3cmdfull   *cmd;
 
-    // detect command group
-    switch( packet->masked_cmd1 )
-        {
-        case    CMD1_GROUP_STATUS_REPLY:
-            ret = P3UserDecodeStatusReply( MyComms, packet );
-            break;
+    (void)MyComms;
+    (void)context;
 
-        default:
-            ret = 0;
-            break;
-        }
+    // nothing to do for a NAK or timeout
+    if( status != kP3ReqReply )
+        return;
 
-    return(ret);
+    cmd = &reply->command.cmdpak.cmd;
+
+    // Check for valid data length
+    if( (cmd->cmd2 == CMD2_STATUS_GETMOTORS) && (cmd->length == 10) ) {
+        // data is in range 0-254, shift to +/- 127
+        remote_motor[0]  = cmd->data[0] - 0x7F;
+        remote_motor[1]  = cmd->data[1] - 0x7F;
+        remote_motor[2]  = cmd->data[2] - 0x7F;
+        remote_motor[3]  = cmd->data[3] - 0x7F;
+        remote_motor[4]  = cmd->data[4] - 0x7F;
+        remote_motor[5]  = cmd->data[5] - 0x7F;
+        remote_motor[6]  = cmd->data[6] - 0x7F;
+        remote_motor[7]  = cmd->data[7] - 0x7F;
+        remote_motor[8]  = cmd->data[8] - 0x7F;
+        remote_motor[9]  = cmd->data[9] - 0x7F;
+        }
 }
 
 /*---------------------------------------------------------------------------*/
@@ -310,99 +338,120 @@ void serialCommsTaskM(void *arg)
 /*  Task that sends messages to the slave                                      */
 /*-----------------------------------------------------------------------------*/
 
-typedef enum {
-    kStateIdle        =  0,
-    kStateCheckOnline = 10,
-    kStateCheckInit_1 = 20,
-    kStateCheckInit_2,
-    kStateCheckInit_3,
-    kStateCheckInit_4,
-    kStateCheckInit_5,
-    kStateCheckInit_6,
-    kStatePoll        = 30
-    } commsState;
-
 void serialMasterTask(void *arg)
 {
-    static  commsState  state;
-            int     i;
+    int     i;
+    int     status;
+    int     known;
+    int     mirrorCount = 0;
+    int     mirrorNaks;
+    unsigned char   motors[10];
+    p3cmd   setMotors = { CMD1_GROUP_CONTROL, CMD2_CONTROL_SETMOTORS, 10, {0} };
+    p3device    *slave = P3GetDevice( MyCommsM, CORTEX_DEVICE_ID );
 
     (void) arg;
 
+    // Each P3Transact returns as soon as the comms task has decoded the
+    // reply so bring up takes one round trip rather than a fixed
+    // delay for every step
     while(1)
         {
-        if( state >= kStateCheckInit_1 )
+        // comms task probes with backoff while the slave is absent
+        if( slave->online == 0 )
             {
-            if( MyCommsM->online == 0 )
-                 state = kStateIdle;
+            taskDelay(10);
+            continue;
             }
 
-        switch(state)
+        // A slave we have seen before only needs the fingerprint that
+        // comes with the device type
+        known = 0;
+        if( P3IdentityLookup( MyCommsM, CORTEX_DEVICE_ID ) != NULL )
             {
-            case    kStateIdle:
-                // Use device ID as the message to detect slave presence
-                P3Command( MyCommsM, &Cmd_Dev_Type, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-
-            case    kStateCheckOnline:
-                if( MyCommsM->online != 0 )
-                    state = kStateCheckInit_1; // reply received so move on
-                else
-                    state = kStateIdle;        // Try again
-                break;
-
-            // Ask for all system related stuff just for fun.
-            case    kStateCheckInit_1:
-                P3Command( MyCommsM, &Cmd_Manufacturer_Request, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-            case    kStateCheckInit_2:
-                P3Command( MyCommsM, &Cmd_ProductName_Request, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-            case    kStateCheckInit_3:
-                P3Command( MyCommsM, &Cmd_SerialNumber_Request, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-            case    kStateCheckInit_4:
-                P3Command( MyCommsM, &Cmd_FirmwareRev_Request, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-            case    kStateCheckInit_5:
-                P3Command( MyCommsM, &Cmd_HardwareRev_Request, CORTEX_DEVICE_ID  );
-                state++;
-                break;
-
-            case    kStateCheckInit_6:
-                // Get current status of remote motors
-                // we don't do much with this other than save when the reply arrives
-                // if motors not under js control were running they will maintain
-                // their current speed.
-                P3Command( MyCommsM, &Cmd_Motor_Status_Req, CORTEX_DEVICE_ID  );
-                state =     kStatePoll;
-                break;
-
-            case        kStatePoll:
-                // for demo, move joystick data into motors 0 through 3
-                remote_motor[0] = joystickGetAnalog( 1, 1 );
-                remote_motor[1] = joystickGetAnalog( 1, 2 );
-                remote_motor[2] = joystickGetAnalog( 1, 3 );
-                remote_motor[3] = joystickGetAnalog( 1, 4 );
-
-                // Send data for all motors
-                for( i=0;i<10;i++ )
-                    Cmd_Set_Motors.data[i] = remote_motor[i] + 0x7F;
+            status = P3Transact( MyCommsM, &Cmd_Dev_Type, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+            if( status == kP3ReqTimeout || status < 0 )
+                {
+                // Try again, also if the request could not be queued
+                taskDelay(10);
+                continue;
+                }
+            if( status == kP3ReqReply )
+                known = (P3IdentityRestore( MyCommsM, CORTEX_DEVICE_ID ) == P3_SUCCESS);
+            }
+
+        // New or changed slave, identify detects the slave and fetches
+        // all system related stuff in one round trip
+        if( !known )
+            {
+            status = P3Transact( MyCommsM, &Cmd_Identify, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+            if( status == kP3ReqTimeout || status < 0 )
+                {
+                // Try again, also if the request could not be queued
+                taskDelay(10);
+                continue;
+                }
 
-                P3Command( MyCommsM, &Cmd_Set_Motors, CORTEX_DEVICE_ID  );
-                break;
+            // Older slaves NAK identify, ask for each item separately
+            if( status == kP3ReqNak )
+                {
+                P3Transact( MyCommsM, &Cmd_Dev_Type,             CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                P3Transact( MyCommsM, &Cmd_Manufacturer_Request, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                P3Transact( MyCommsM, &Cmd_ProductName_Request,  CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                P3Transact( MyCommsM, &Cmd_SerialNumber_Request, CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                P3Transact( MyCommsM, &Cmd_FirmwareRev_Request,  CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                P3Transact( MyCommsM, &Cmd_HardwareRev_Request,  CORTEX_DEVICE_ID, NULL, P3_TRANSACT_TIMEOUT );
+                }
 
-            default:
-                state++;
-                break;
+            P3IdentitySave( MyCommsM, CORTEX_DEVICE_ID );
             }
 
-        taskDelay(10);
+        // slaves without mirroring NAK the sync, see below
+        mirrorNaks = MyCommsM->MirrorNakCount;
+
+        // poll until the slave goes away
+        while( slave->online != 0 )
+            {
+            // for demo, move joystick data into motors 0 through 3
+            remote_motor[0] = joystickGetAnalog( 1, 1 );
+            remote_motor[1] = joystickGetAnalog( 1, 2 );
+            remote_motor[2] = joystickGetAnalog( 1, 3 );
+            remote_motor[3] = joystickGetAnalog( 1, 4 );
+
+            // Mirror data for all motors, only changes go over the link
+            for( i=0;i<10;i++ )
+                motors[i] = remote_motor[i] + 0x7F;
+
+            // slave comms still answer but its application has stopped,
+            // stop the motors rather than leave them running
+            if( (slave->heartbeats != 0) && !P3DeviceAlive( MyCommsM, CORTEX_DEVICE_ID, HEARTBEAT_QUIET ) )
+                {
+                for( i=0;i<10;i++ )
+                    motors[i] = 0x7F;
+                }
+
+            // a slave that NAKed the sync gets all motors as a command
+            if( MyCommsM->MirrorNakCount != mirrorNaks )
+                {
+                for( i=0;i<10;i++ )
+                    setMotors.data[i] = motors[i];
+                P3Submit( MyCommsM, &setMotors, CORTEX_DEVICE_ID );
+                }
+            else
+                {
+                P3MirrorWrite( MyCommsM, MIRROR_MOTORS, motors, 10 );
+                P3MirrorSync( MyCommsM, CORTEX_DEVICE_ID );
+                }
+
+            // slave pushes its motor values back with each mirror reply
+            // so the motor status poll is not needed while these arrive
+            if( MyCommsM->MirrorRxCount != mirrorCount )
+                {
+                mirrorCount = MyCommsM->MirrorRxCount;
+                P3ScheduleFresh( MyCommsM, motorStatusSlot );
+                }
+
+            taskDelay(10);
+            }
         }
 }
 
@@ -410,9 +459,13 @@ void serialMasterTask(void *arg)
 /*  serial comms task for slave                                                */
 /*-----------------------------------------------------------------------------*/
 
+p3comms  *MyCommsS;
+
 void serialCommsTaskS(void *arg)
 {
-    p3comms  *MyCommsS;
+    int       mirrorCount = 0;
+    int       i;
+    unsigned char   motors[10];
 
     (void)arg;
 
@@ -423,6 +476,9 @@ void serialCommsTaskS(void *arg)
     if(MyCommsS == NULL)
         return;
 
+    // only answer frames for our address
+    P3SetAddress( MyCommsS, CORTEX_DEVICE_ID );
+
     // set device type - whatever you want
     MyCommsS->deviceType[0] = 0x12;
     MyCommsS->deviceType[1] = 0x34;
@@ -435,6 +491,9 @@ void serialCommsTaskS(void *arg)
     P3SetFirmwareVersion( MyCommsS, 1, 0, 0, 0);
     P3SetHardwareVersion( MyCommsS, 1, 0, 0 );
 
+    // motor status reply is kept ready to send
+    P3RegisterPrebuilt( MyCommsS, CMD1_GROUP_STATUS, CMD2_STATUS_GETMOTORS, &Cmd_Motor_Status, P3UserMotorStatus );
+
     // check for messages
     while( true )
         {
@@ -442,11 +501,48 @@ void serialCommsTaskS(void *arg)
         if(MyCommsS != NULL)
             P3CommsTask( MyCommsS );
 
+        // motor commands mirrored from the master are set by the actuation task
+        if( MyCommsS->MirrorRxCount != mirrorCount )
+            {
+            mirrorCount = MyCommsS->MirrorRxCount;
+            P3MirrorRead( MyCommsS, MIRROR_MOTORS, Cmd_Set_Motors.data, 10 );
+            P3QueuePut( &actuationQueue, &Cmd_Set_Motors );
+            }
+
+        // and mirror back the current motor values
+        for(i=0;i<10;i++)
+            motors[i] = motorGet( i+1 ) + 0x7F;
+        P3MirrorWrite( MyCommsS, MIRROR_MOTORS, motors, 10 );
+
         // P3 comms task expects to be run every 2mS
         taskDelay(2);
         }
 }
 
+/*-----------------------------------------------------------------------------*/
+/*  actuation task for slave, sets motors from the queued commands             */
+/*-----------------------------------------------------------------------------*/
+
+void actuationTask(void *arg)
+{
+    p3cmd   cmd;
+
+    (void)arg;
+
+    while( true )
+        {
+        while( P3QueueGet( &actuationQueue, &cmd ) == P3_SUCCESS )
+            P3UserActuate( &cmd );
+
+        // let the master know we are still running
+        if( MyCommsS != NULL )
+            P3Heartbeat( MyCommsS );
+
+        // runs at its own rate, independent of the comms
+        taskDelay(5);
+        }
+}
+
 /*-----------------------------------------------------------------------------*/
 /*  Initialize slave                                                           */
 /*-----------------------------------------------------------------------------*/
@@ -454,7 +550,10 @@ void serialCommsTaskS(void *arg)
 void
 serialSlaveInit(void)
 {
+    P3QueueInit( &actuationQueue );
+
     taskCreate(serialCommsTaskS, 512, NULL,TASK_PRIORITY_DEFAULT + 2);
+    taskCreate(actuationTask, 512, NULL,TASK_PRIORITY_DEFAULT + 1);
 }
 
 /*-----------------------------------------------------------------------------*/
@@ -470,9 +569,74 @@ serialMasterInit(void)
     // Start task if no error
     if(MyCommsM != NULL)
         {
-        P3SetReplyDecoder( MyCommsM, P3UserDecodePacketMaster );
+        // probe the slave only when the link goes quiet
+        P3SetLiveness( MyCommsM, CORTEX_DEVICE_ID, P3_LIVENESS_QUIET );
+
+        // Get current status of remote motors every 100mS
+        // we don't do much with this other than save when the reply arrives
+        // if motors not under js control were running they will maintain
+        // their current speed.
+        motorStatusSlot = P3ScheduleAdd( MyCommsM, CORTEX_DEVICE_ID, &Cmd_Motor_Status_Req, 10, 50, P3UserMotorStatusDone, NULL );
+        P3SchedulePriority( MyCommsM, motorStatusSlot, 1 );
+
+        // device type once a second at low priority, slow items like
+        // this fill in around the motor polls
+        P3ScheduleAdd( MyCommsM, CORTEX_DEVICE_ID, &Cmd_Dev_Type, P3_DEVICE_TYPE_LEN + P3_FINGERPRINT_LEN, 500, NULL, NULL );
 
         taskCreate(serialCommsTaskM, 512, NULL,TASK_PRIORITY_DEFAULT + 2);
         taskCreate(serialMasterTask, 512, NULL,TASK_PRIORITY_DEFAULT );
         }
 }
+
+/*-----------------------------------------------------------------------------*/
+/*  router task, forwards frames between the two ports                         */
+/*-----------------------------------------------------------------------------*/
+
+p3comms  *MyCommsUp;
+p3comms  *MyCommsDown;
+
+void serialRouterTask(void *arg)
+{
+    (void)arg;
+
+    while( true )
+        {
+        P3CommsTask( MyCommsUp );
+        P3CommsTask( MyCommsDown );
+
+        // each call sends on whatever has arrived so run more often
+        // than the other comms tasks
+        taskDelay(1);
+        }
+}
+
+/*-----------------------------------------------------------------------------*/
+/*  Initialize router, use instead of the slave and master to pass frames      */
+/*  along a chain of controllers                                               */
+/*-----------------------------------------------------------------------------*/
+
+void
+serialRouterInit(void)
+{
+    int     i;
+
+    // upstream port faces the master, downstream the rest of the chain
+    MyCommsUp   = P3Init( SLAVE_PORT,  kP3ModeSlave,  0, 230400 );
+    MyCommsDown = P3Init( MASTER_PORT, kP3ModeMaster, 0, 230400 );
+
+    if( (MyCommsUp == NULL) || (MyCommsDown == NULL) )
+        return;
+
+    P3SetAddress( MyCommsUp, CORTEX_DEVICE_ID );
+
+    // we answer as CORTEX_DEVICE_ID, frames for anyone else go down
+    // the chain and all replies go back up
+    for(i=0;i<16;i++)
+        {
+        if( i != CORTEX_DEVICE_ID )
+            P3SetRoute( MyCommsUp, i, MyCommsDown );
+        P3SetRoute( MyCommsDown, i, MyCommsUp );
+        }
+
+    taskCreate(serialRouterTask, 512, NULL,TASK_PRIORITY_DEFAULT + 2);
+}